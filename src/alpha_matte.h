@@ -0,0 +1,169 @@
+/*!
+  \file        alpha_matte.h
+  \author      Arnaud Ramey <arnaud.a.ramey@gmail.com>
+                -- Robotics Lab, University Carlos III of Madrid
+  \date        2013/10/20
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+
+\class AlphaMatte
+\brief Turns a binary user map into a soft alpha matte,
+following the edges of the color image.
+
+It is a guided filter (He et al., "Guided Image Filtering", ECCV 2010)
+of the user mask, with the gray image as a guide.
+The filter is only computed in a band around the edge of the mask:
+outside the band, the alpha is 255 for the user, 0 for the background.
+The box filters are O(1) per pixel and run on the bounding box
+of the band only.
+
+ */
+
+#ifndef ALPHA_MATTE_H
+#define ALPHA_MATTE_H
+
+#include <opencv2/imgproc/imgproc.hpp>
+#include "morph_utils.h"
+
+class AlphaMatte {
+public:
+  /*!
+   * \param radius
+   *    the radius of the guided filter windows, in pixels
+   * \param eps
+   *    the regularization of the guided filter, for intensities in [0, 1].
+   *    Bigger is smoother.
+   * \param band_radius
+   *    the half width of the band around the edges that is refined
+   */
+  AlphaMatte(const int radius = 4, const float eps = 1E-3,
+             const int band_radius = 6)
+    : _radius(radius), _eps(eps), _band_radius(band_radius) {}
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * \param color
+   *    the guide image
+   * \param user
+   *    the user map, non null pixels are the users
+   * \param alpha
+   *    the output, 255 for the users, 0 for the background,
+   *    intermediate values in the band around the edges
+   */
+  void compute(const cv::Mat3b & color, const cv::Mat1b & user,
+               cv::Mat1b & alpha) {
+    cv::threshold(user, _mask, 0, 255, CV_THRESH_BINARY);
+    int band_size = 2 * _band_radius + 1;
+    _morph.dilate_rect(_mask, _dilated, band_size, band_size);
+    _morph.erode_rect(_mask, alpha, band_size, band_size);
+
+    // the bounding box of the band, plus the filter support
+    cv::Rect bbox = image_utils::nonzero_bbox(_dilated);
+    if (bbox.width == 0)
+      return;
+    cv::Rect roi(bbox.x - _radius, bbox.y - _radius,
+                 bbox.width + 2 * _radius, bbox.height + 2 * _radius);
+    roi &= cv::Rect(0, 0, user.cols, user.rows);
+
+    // guided filter in the roi
+    cv::cvtColor(color(roi), _gray, cv::COLOR_BGR2GRAY);
+    _gray.convertTo(_I, CV_32F, 1. / 255);
+    _mask(roi).convertTo(_p, CV_32F, 1. / 255);
+    cv::Size win(2 * _radius + 1, 2 * _radius + 1);
+    cv::multiply(_I, _p, _Ip);
+    cv::multiply(_I, _I, _II);
+    cv::boxFilter(_I, _mean_I, CV_32F, win);
+    cv::boxFilter(_p, _mean_p, CV_32F, win);
+    cv::boxFilter(_Ip, _mean_Ip, CV_32F, win);
+    cv::boxFilter(_II, _mean_II, CV_32F, win);
+    // a = cov(I, p) / (var(I) + eps), b = mean_p - a * mean_I
+    _a.create(roi.size());
+    _b.create(roi.size());
+    for (int row = 0; row < roi.height; ++row) {
+      const float* mean_I = _mean_I[row], *mean_p = _mean_p[row],
+          *mean_Ip = _mean_Ip[row], *mean_II = _mean_II[row];
+      float* a = _a[row], *b = _b[row];
+      for (int col = 0; col < roi.width; ++col) {
+        float cov = mean_Ip[col] - mean_I[col] * mean_p[col];
+        float var = mean_II[col] - mean_I[col] * mean_I[col];
+        a[col] = cov / (var + _eps);
+        b[col] = mean_p[col] - a[col] * mean_I[col];
+      } // end loop col
+    } // end loop row
+    cv::boxFilter(_a, _mean_a, CV_32F, win);
+    cv::boxFilter(_b, _mean_b, CV_32F, win);
+
+    // q = mean_a * I + mean_b, only in the band
+    for (int row = 0; row < roi.height; ++row) {
+      const float* mean_a = _mean_a[row], *mean_b = _mean_b[row], *I = _I[row];
+      const uchar* dilated = _dilated.ptr<uchar>(row + roi.y) + roi.x;
+      uchar* alpha_data = alpha.ptr<uchar>(row + roi.y) + roi.x;
+      for (int col = 0; col < roi.width; ++col) {
+        if (dilated[col] == 0 || alpha_data[col] != 0)
+          continue; // not in the band
+        float q = mean_a[col] * I[col] + mean_b[col];
+        alpha_data[col] = cv::saturate_cast<uchar>(255 * q);
+      } // end loop col
+    } // end loop row
+  } // end compute();
+
+private:
+  int _radius;
+  float _eps;
+  int _band_radius;
+  image_utils::MaskMorphology _morph;
+  cv::Mat1b _mask, _dilated, _gray;
+  cv::Mat1f _I, _p, _Ip, _II, _mean_I, _mean_p, _mean_Ip, _mean_II;
+  cv::Mat1f _a, _b, _mean_a, _mean_b;
+}; // end class AlphaMatte
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace image_utils {
+
+/*!
+ * Blend \a fg over \a out: out = alpha * fg + (1 - alpha) * out.
+ * \param alpha 255 for \a fg only, 0 for \a out only
+ */
+inline void alpha_blend(const cv::Mat3b & fg, const cv::Mat1b & alpha,
+                        cv::Mat3b & out) {
+  for (int row = 0; row < out.rows; ++row) {
+    const uchar* alpha_data = alpha.ptr<uchar>(row);
+    const uchar* fg_data = fg.ptr<uchar>(row);
+    uchar* out_data = out.ptr<uchar>(row);
+    for (int col = 0; col < out.cols; ++col) {
+      int a = alpha_data[col];
+      if (a == 0)
+        continue;
+      int idx = 3 * col;
+      if (a == 255) {
+        out_data[idx    ] = fg_data[idx    ];
+        out_data[idx + 1] = fg_data[idx + 1];
+        out_data[idx + 2] = fg_data[idx + 2];
+        continue;
+      }
+      for (int channel = idx; channel < idx + 3; ++channel)
+        out_data[channel] = (a * fg_data[channel]
+                             + (255 - a) * out_data[channel] + 127) / 255;
+    } // end loop col
+  } // end loop row
+} // end alpha_blend();
+
+} // end namespace image_utils
+
+#endif // ALPHA_MATTE_H
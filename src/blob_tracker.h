@@ -0,0 +1,292 @@
+/*!
+  \file        blob_tracker.h
+  \author      Arnaud Ramey <arnaud.a.ramey@gmail.com>
+                -- Robotics Lab, University Carlos III of Madrid
+  \date        2013/10/20
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+
+\class BlobTracker
+\brief A lightweight tracker giving stable IDs to the blobs of a label map.
+
+The blobs of each frame are described by their \a UserStats.
+They are matched to the existing tracks with a greedy assignment
+on a cost mixing centroid distance, bounding box overlap and depth difference.
+Pairs are gated: too far or too different pairs are never matched.
+
+A track that is not matched is kept, with a constant velocity prediction,
+for a few frames, so that IDs survive brief occlusions.
+
+Everything works on the blob stats, not on the pixels:
+the update is a few microseconds for a dozen of blobs.
+Only relabel() touches the pixels, with a lookup table.
+
+ */
+
+#ifndef BLOB_TRACKER_H
+#define BLOB_TRACKER_H
+
+#include <algorithm>
+#include "debug.h"
+#include "user_stats.h"
+
+class BlobTracker {
+public:
+  struct Track {
+    //! the stable ID of the track, in [1, 255]
+    uchar id;
+    cv::Rect bbox;
+    cv::Point2f centroid;
+    //! pixels per frame
+    cv::Point2f velocity;
+    //! the median depth, in meters (0 if unknown)
+    float depth;
+    int area;
+    //! the number of frames since the creation of the track
+    int age;
+    //! the number of consecutive frames without a matching blob
+    int missed;
+  };
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * \param max_centroid_dist
+   *    in pixels, the gating distance between a track prediction and a blob
+   * \param max_depth_diff
+   *    in meters, the gating depth difference
+   * \param max_missed_frames
+   *    how many frames a track survives without a matching blob
+   * \param min_area
+   *    blobs smaller than that (pixels) are not tracked and set to 0
+   */
+  BlobTracker(const float max_centroid_dist = 80,
+              const float max_depth_diff = .5,
+              const int max_missed_frames = 15,
+              const int min_area = 200) :
+    _max_centroid_dist(max_centroid_dist),
+    _max_depth_diff(max_depth_diff),
+    _max_missed_frames(max_missed_frames),
+    _min_area(min_area),
+    _next_id(1) {
+    std::fill(_label_to_id, _label_to_id + UserStats::MAX_LABELS, 0);
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! remove all tracks
+  void reset() {
+    _tracks.clear();
+    _next_id = 1;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * Match the blobs of the new frame with the tracks.
+   * \param stats the stats of the labelled blobs of the new frame
+   */
+  void update(const UserStats & stats) {
+    // reset the lookup table of the previous frame
+    for (unsigned int i = 0; i < _blob_labels.size(); ++i)
+      _label_to_id[_blob_labels[i]] = 0;
+    // keep only the big enough blobs
+    _blob_labels.clear();
+    const std::vector<uchar> & labels = stats.labels();
+    for (unsigned int i = 0; i < labels.size(); ++i) {
+      if (stats.get(labels[i]).area >= _min_area)
+        _blob_labels.push_back(labels[i]);
+    }
+    unsigned int nblobs = _blob_labels.size(), ntracks = _tracks.size();
+
+    // build the gated pairs
+    _pairs.clear();
+    for (unsigned int track_idx = 0; track_idx < ntracks; ++track_idx) {
+      const Track & track = _tracks[track_idx];
+      // constant velocity prediction, the gate grows with the occlusion
+      float dt = 1 + track.missed;
+      cv::Point2f pred(track.centroid.x + dt * track.velocity.x,
+                       track.centroid.y + dt * track.velocity.y);
+      float gate_dist = _max_centroid_dist * (1 + .5f * track.missed);
+      cv::Rect pred_bbox(track.bbox.x + dt * track.velocity.x,
+                         track.bbox.y + dt * track.velocity.y,
+                         track.bbox.width, track.bbox.height);
+      for (unsigned int blob_idx = 0; blob_idx < nblobs; ++blob_idx) {
+        const UserStats::Stats & blob = stats.get(_blob_labels[blob_idx]);
+        float dx = blob.centroid.x - pred.x, dy = blob.centroid.y - pred.y;
+        float dist = sqrt(dx * dx + dy * dy);
+        if (dist > gate_dist)
+          continue;
+        float depth_diff = 0;
+        if (track.depth > 0 && blob.depth_count > 0) {
+          depth_diff = fabs(track.depth - blob.depth_median);
+          if (depth_diff > _max_depth_diff)
+            continue;
+        }
+        Pair pair;
+        pair.track_idx = track_idx;
+        pair.blob_idx = blob_idx;
+        pair.cost = dist / gate_dist
+            + depth_diff / _max_depth_diff
+            + (1 - bbox_iou(pred_bbox, blob.bbox));
+        _pairs.push_back(pair);
+      } // end loop blob_idx
+    } // end loop track_idx
+
+    // greedy assignment, cheapest pairs first
+    std::sort(_pairs.begin(), _pairs.end());
+    _track_matched.assign(ntracks, false);
+    _blob_matched.assign(nblobs, false);
+    for (unsigned int pair_idx = 0; pair_idx < _pairs.size(); ++pair_idx) {
+      const Pair & pair = _pairs[pair_idx];
+      if (_track_matched[pair.track_idx] || _blob_matched[pair.blob_idx])
+        continue;
+      _track_matched[pair.track_idx] = true;
+      _blob_matched[pair.blob_idx] = true;
+      uchar label = _blob_labels[pair.blob_idx];
+      Track & track = _tracks[pair.track_idx];
+      const UserStats::Stats & blob = stats.get(label);
+      float dt = 1 + track.missed;
+      // smooth the velocity
+      track.velocity.x = .5f * track.velocity.x
+          + .5f * (blob.centroid.x - track.centroid.x) / dt;
+      track.velocity.y = .5f * track.velocity.y
+          + .5f * (blob.centroid.y - track.centroid.y) / dt;
+      set_track_blob(track, blob);
+      ++track.age;
+      track.missed = 0;
+      _label_to_id[label] = track.id;
+    } // end loop pair_idx
+
+    // unmatched tracks: keep them for a while
+    unsigned int kept = 0;
+    for (unsigned int track_idx = 0; track_idx < ntracks; ++track_idx) {
+      Track & track = _tracks[track_idx];
+      if (!_track_matched[track_idx]) {
+        ++track.age;
+        ++track.missed;
+        if (track.missed > _max_missed_frames)
+          continue; // drop it
+      }
+      _tracks[kept++] = track;
+    } // end loop track_idx
+    _tracks.resize(kept);
+
+    // unmatched blobs: new tracks
+    for (unsigned int blob_idx = 0; blob_idx < nblobs; ++blob_idx) {
+      if (_blob_matched[blob_idx])
+        continue;
+      uchar id = get_free_id();
+      if (id == 0) {
+        maggieDebug2("BlobTracker: no more free ID!");
+        break;
+      }
+      uchar label = _blob_labels[blob_idx];
+      Track track;
+      track.id = id;
+      track.velocity = cv::Point2f(0, 0);
+      track.age = 0;
+      track.missed = 0;
+      set_track_blob(track, stats.get(label));
+      _tracks.push_back(track);
+      _label_to_id[label] = id;
+    } // end loop blob_idx
+  } // end update();
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * Replace the labels of the frame given to the last update()
+   * by the IDs of their tracks. Untracked blobs are set to 0.
+   */
+  inline void relabel(cv::Mat1b & user) const {
+    for (int row = 0; row < user.rows; ++row) {
+      uchar* data = user.ptr<uchar>(row);
+      for (int col = 0; col < user.cols; ++col)
+        data[col] = _label_to_id[data[col]];
+    } // end loop row
+  }
+
+  //! \return the ID given to a label of the last frame, 0 if untracked
+  inline uchar label_to_id(const uchar label) const { return _label_to_id[label]; }
+
+  //! the current tracks, including the ones not seen in the last frame
+  inline const std::vector<Track> & tracks() const { return _tracks; }
+
+private:
+  struct Pair {
+    unsigned int track_idx, blob_idx;
+    float cost;
+    inline bool operator < (const Pair & other) const { return cost < other.cost; }
+  };
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  static inline float bbox_iou(const cv::Rect & a, const cv::Rect & b) {
+    int inter = (a & b).area();
+    int uni = a.area() + b.area() - inter;
+    return (uni <= 0 ? 0 : 1.f * inter / uni);
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  inline void set_track_blob(Track & track, const UserStats::Stats & blob) const {
+    track.bbox = blob.bbox;
+    track.centroid = blob.centroid;
+    track.area = blob.area;
+    if (blob.depth_count > 0)
+      track.depth = blob.depth_median;
+    else if (track.age == 0)
+      track.depth = 0;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! \return an ID not used by the current tracks, 0 if none.
+  //! IDs are cycled so that a lost ID is not reused immediately.
+  inline uchar get_free_id() {
+    for (int trial = 0; trial < 255; ++trial) {
+      uchar id = _next_id;
+      _next_id = (_next_id == 255 ? 1 : _next_id + 1);
+      bool used = false;
+      for (unsigned int track_idx = 0; track_idx < _tracks.size(); ++track_idx) {
+        if (_tracks[track_idx].id == id) {
+          used = true;
+          break;
+        }
+      } // end loop track_idx
+      if (!used)
+        return id;
+    } // end loop trial
+    return 0;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  float _max_centroid_dist;
+  float _max_depth_diff;
+  int _max_missed_frames;
+  int _min_area;
+  uchar _next_id;
+  std::vector<Track> _tracks;
+  std::vector<uchar> _blob_labels;
+  std::vector<Pair> _pairs;
+  std::vector<bool> _track_matched, _blob_matched;
+  uchar _label_to_id[UserStats::MAX_LABELS];
+}; // end class BlobTracker
+
+#endif // BLOB_TRACKER_H
@@ -0,0 +1,148 @@
+/*!
+  \file        clean_plate.h
+  \author      Arnaud Ramey <arnaud.a.ramey@gmail.com>
+                -- Robotics Lab, University Carlos III of Madrid
+  \date        2013/10/20
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+
+\class CleanPlate
+\brief The color of the static background, learnt where no user is seen.
+
+For a static camera: each pixel out of the user mask updates the plate
+with a running average (the first observation is copied).
+The average is kept in fixed point with PLATE_SHIFT fractional bits,
+with rounding to the nearest, so that it converges to the true background
+both when it gets darker and when it gets brighter.
+The pixels in the user mask are then replaced by the plate,
+if they were observed at least once.
+The pixels never observed are given back, with their bounding box,
+so that they can be filled by a slower method (inpainting...).
+
+ */
+
+#ifndef CLEAN_PLATE_H
+#define CLEAN_PLATE_H
+
+#include <opencv2/core/core.hpp>
+
+class CleanPlate {
+public:
+  //! the fractional bits of the running average
+  static const int PLATE_SHIFT = 8;
+
+  /*!
+   * \param learning_shift
+   *    the plate moves by 1 / 2^learning_shift towards the new color
+   */
+  CleanPlate(const int learning_shift = 2) : _learning_shift(learning_shift) {}
+
+  //! forget the plate
+  inline void reset() { _observed.release(); }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * Learn the plate out of \a mask and fill \a mask with it.
+   * \param color
+   *    the current image
+   * \param mask
+   *    the pixels (!= 0) to replace, the users
+   * \param out
+   *    the result, cannot be \a color
+   * \param unobserved
+   *    the pixels of \a mask never observed: 255, 0 otherwise
+   * \return the bounding box of \a unobserved, empty if there is none
+   */
+  cv::Rect apply(const cv::Mat3b & color, const cv::Mat1b & mask,
+                 cv::Mat3b & out, cv::Mat1b & unobserved) {
+    if (_observed.size() != color.size()) {
+      _plate.create(color.size());
+      _accum.create(color.size());
+      _observed.create(color.size());
+      _observed.setTo(0);
+    }
+    out.create(color.size());
+    unobserved.create(color.size());
+    int xmin = color.cols, xmax = -1, ymin = color.rows, ymax = -1;
+    // to round the update to the nearest instead of towards -inf
+    int round_half = (_learning_shift > 0 ? 1 << (_learning_shift - 1) : 0);
+    for (int row = 0; row < color.rows; ++row) {
+      const uchar* color_data = color.ptr<uchar>(row);
+      const uchar* mask_data = mask.ptr<uchar>(row);
+      uchar* plate_data = _plate.ptr<uchar>(row);
+      unsigned short* accum_data = _accum.ptr<unsigned short>(row);
+      uchar* observed_data = _observed.ptr<uchar>(row);
+      uchar* out_data = out.ptr<uchar>(row);
+      uchar* unobserved_data = unobserved.ptr<uchar>(row);
+      for (int col = 0; col < color.cols; ++col) {
+        unobserved_data[col] = 0;
+        const uchar* c = color_data + 3 * col;
+        uchar* p = plate_data + 3 * col;
+        unsigned short* a = accum_data + 3 * col;
+        uchar* o = out_data + 3 * col;
+        if (mask_data[col] == 0) { // background: learn
+          if (observed_data[col] == 0) {
+            for (int i = 0; i < 3; ++i) {
+              a[i] = c[i] << PLATE_SHIFT;
+              p[i] = c[i];
+            }
+            observed_data[col] = 255;
+          }
+          else {
+            for (int i = 0; i < 3; ++i) {
+              int diff = (c[i] << PLATE_SHIFT) - a[i];
+              a[i] += (diff + round_half) >> _learning_shift;
+              p[i] = (a[i] + (1 << (PLATE_SHIFT - 1))) >> PLATE_SHIFT;
+            }
+          }
+          o[0] = c[0]; o[1] = c[1]; o[2] = c[2];
+        }
+        else if (observed_data[col] != 0) { // user: copy the plate
+          o[0] = p[0]; o[1] = p[1]; o[2] = p[2];
+        }
+        else { // user never seen behind
+          o[0] = c[0]; o[1] = c[1]; o[2] = c[2];
+          unobserved_data[col] = 255;
+          xmin = std::min(xmin, col);
+          xmax = std::max(xmax, col);
+          ymin = std::min(ymin, row);
+          ymax = std::max(ymax, row);
+        }
+      } // end loop col
+    } // end loop row
+    if (xmax < 0)
+      return cv::Rect();
+    return cv::Rect(xmin, ymin, xmax - xmin + 1, ymax - ymin + 1);
+  } // end apply();
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! the learnt background, valid where observed() != 0
+  inline const cv::Mat3b & plate() const { return _plate; }
+  inline const cv::Mat1b & observed() const { return _observed; }
+
+private:
+  int _learning_shift;
+  cv::Mat3b _plate;
+  //! the plate in fixed point, with PLATE_SHIFT fractional bits
+  cv::Mat3w _accum;
+  //! 255 for the pixels observed at least once out of the mask
+  cv::Mat1b _observed;
+}; // end class CleanPlate
+
+#endif // CLEAN_PLATE_H
@@ -0,0 +1,291 @@
+/*!
+  \file        color_background_model.h
+  \author      Arnaud Ramey <arnaud.a.ramey@gmail.com>
+                -- Robotics Lab, University Carlos III of Madrid
+  \date        2013/10/20
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+
+\class ColorBackgroundModel
+\brief A per-pixel mixture of Gaussians of the background colors,
+in fixed point, continuously learnt.
+
+Each pixel has NMODES modes (weight, BGR mean, isotropic variance),
+kept sorted by decreasing weight.
+A color matches a mode if it is within MATCH_SIGMA2 variances of its mean.
+A pixel is background if it matches one of the heaviest modes
+that account together for BG_RATIO of the total weight.
+
+The model only learns where the pixels are marked as free of users,
+so that a still user does not fade into the background.
+The learning rate is 2^-learning_shift, faster for the first frames
+so that the model bootstraps in a few frames.
+
+The model is stored as planes (one per mode and per field),
+and the rows are processed in parallel.
+
+ */
+
+#ifndef COLOR_BACKGROUND_MODEL_H
+#define COLOR_BACKGROUND_MODEL_H
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/core/version.hpp>
+#include <vector>
+
+#if (CV_MAJOR_VERSION > 2) || (CV_MAJOR_VERSION == 2 && CV_MINOR_VERSION > 3)
+#define COLOR_BACKGROUND_MODEL_PARALLEL
+#endif
+
+class ColorBackgroundModel {
+public:
+  //! the number of Gaussians per pixel
+  static const int NMODES = 3;
+  //! fixed point shifts: weights in Q15, means in Q8, variances in Q4
+  static const int WEIGHT_SHIFT = 15;
+  static const int MEAN_SHIFT = 8;
+  static const int VAR_SHIFT = 4;
+  //! the squared distance, in variances, to match a mode (3 channels x 2.5^2)
+  static const int MATCH_SIGMA2 = 19;
+  //! the variance bounds and the variance of a new mode, in pixel values^2
+  static const int VAR_MIN = 16;
+  static const int VAR_MAX = 1600;
+  static const int VAR_INIT = 225;
+  //! the proportion of the total weight explained by background modes, in %
+  static const int BG_RATIO_PERCENT = 75;
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * \param learning_shift
+   *    the learning rate is 2^-learning_shift per frame.
+   *    7 => 1/128, about 4 seconds at 30 fps.
+   */
+  ColorBackgroundModel(const int learning_shift = 7)
+    : _learning_shift(learning_shift), _nframes(0) {}
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! forget everything learnt. The next frame will be the new background.
+  inline void reset() {
+    _nframes = 0;
+    _size = cv::Size();
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * Classify the pixels of \a frame, then update the model with it.
+   * \param frame
+   *    the BGR image
+   * \param fg_mask
+   *    the output, 255 for foreground pixels, 0 for background
+   * \param no_learn_mask
+   *    if not empty, of the same size as \a frame.
+   *    The pixels where it is not null (the users) are classified
+   *    but not learnt.
+   * \param learn
+   *    if false, only classify
+   */
+  void apply(const cv::Mat3b & frame, cv::Mat1b & fg_mask,
+             const cv::Mat1b & no_learn_mask = cv::Mat1b(),
+             bool learn = true) {
+    if (frame.size() != _size)
+      init(frame.size());
+    fg_mask.create(frame.size());
+    const cv::Mat1b* no_learn =
+        (!no_learn_mask.empty() && no_learn_mask.size() == frame.size()
+         ? &no_learn_mask : NULL);
+    // bootstrap: alpha = max(1 / (nframes + 1), 2^-learning_shift)
+    int shift = 0;
+    while (shift < _learning_shift && (1 << (shift + 1)) <= _nframes + 1)
+      ++shift;
+    RowUpdater updater(*this, frame, fg_mask, no_learn, learn, shift);
+#ifdef COLOR_BACKGROUND_MODEL_PARALLEL
+    cv::parallel_for_(cv::Range(0, frame.rows), updater);
+#else
+    updater(cv::Range(0, frame.rows));
+#endif // COLOR_BACKGROUND_MODEL_PARALLEL
+    if (learn)
+      ++_nframes;
+  } // end apply();
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! the mean of the heaviest mode of each pixel
+  void get_background_image(cv::Mat3b & out) const {
+    out.create(_size);
+    for (int row = 0; row < _size.height; ++row) {
+      cv::Vec3b* out_data = out.ptr<cv::Vec3b>(row);
+      int idx = row * _size.width;
+      for (int col = 0; col < _size.width; ++col, ++idx) {
+        out_data[col] = cv::Vec3b(_mean[0][0][idx] >> MEAN_SHIFT,
+                                  _mean[0][1][idx] >> MEAN_SHIFT,
+                                  _mean[0][2][idx] >> MEAN_SHIFT);
+      } // end loop col
+    } // end loop row
+  }
+
+  //! the number of frames learnt since the last reset
+  inline int nframes() const { return _nframes; }
+
+private:
+  //////////////////////////////////////////////////////////////////////////////
+
+  void init(const cv::Size & size) {
+    _size = size;
+    _nframes = 0;
+    unsigned int npix = size.area();
+    for (int mode = 0; mode < NMODES; ++mode) {
+      _weight[mode].assign(npix, 0);
+      _var[mode].assign(npix, VAR_INIT << VAR_SHIFT);
+      for (int channel = 0; channel < 3; ++channel)
+        _mean[mode][channel].assign(npix, 0);
+    } // end loop mode
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  inline void swap_modes(const unsigned int idx, const int m1, const int m2) {
+    std::swap(_weight[m1][idx], _weight[m2][idx]);
+    std::swap(_var[m1][idx], _var[m2][idx]);
+    for (int channel = 0; channel < 3; ++channel)
+      std::swap(_mean[m1][channel][idx], _mean[m2][channel][idx]);
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! classify and learn one row
+  void process_row(const int row, const cv::Mat3b & frame, cv::Mat1b & fg_mask,
+                   const cv::Mat1b* no_learn, bool learn, const int shift) {
+    const uchar* frame_data = frame.ptr<uchar>(row);
+    uchar* fg_data = fg_mask.ptr<uchar>(row);
+    const uchar* no_learn_data = (no_learn ? no_learn->ptr<uchar>(row) : NULL);
+    unsigned int idx = row * _size.width;
+    for (int col = 0; col < _size.width; ++col, ++idx, frame_data += 3) {
+      int b = frame_data[0], g = frame_data[1], r = frame_data[2];
+      // find the first (heaviest) matching mode
+      int matched = -1;
+      unsigned int total = 0, before_matched = 0;
+      for (int mode = 0; mode < NMODES; ++mode) {
+        unsigned int w = _weight[mode][idx];
+        if (w == 0)
+          break; // modes are sorted, all next ones are empty
+        total += w;
+        if (matched >= 0)
+          continue;
+        int db = b - (_mean[mode][0][idx] >> MEAN_SHIFT);
+        int dg = g - (_mean[mode][1][idx] >> MEAN_SHIFT);
+        int dr = r - (_mean[mode][2][idx] >> MEAN_SHIFT);
+        unsigned int d2 = db * db + dg * dg + dr * dr;
+        if ((d2 << VAR_SHIFT) < MATCH_SIGMA2 * (unsigned int) _var[mode][idx])
+          matched = mode;
+        else
+          before_matched += w;
+      } // end loop mode
+
+      bool is_bg = (matched >= 0
+                    && 100 * before_matched < BG_RATIO_PERCENT * total);
+      fg_data[col] = (is_bg ? 0 : 255);
+
+      if (!learn || (no_learn_data && no_learn_data[col] != 0))
+        continue;
+
+      // no match: replace the lightest mode by the current color
+      if (matched < 0) {
+        matched = NMODES - 1;
+        _weight[matched][idx] = 0;
+        _var[matched][idx] = VAR_INIT << VAR_SHIFT;
+        _mean[matched][0][idx] = b << MEAN_SHIFT;
+        _mean[matched][1][idx] = g << MEAN_SHIFT;
+        _mean[matched][2][idx] = r << MEAN_SHIFT;
+      }
+      else { // update the matched Gaussian
+        int mb = _mean[matched][0][idx], mg = _mean[matched][1][idx],
+            mr = _mean[matched][2][idx];
+        mb += ((b << MEAN_SHIFT) - mb) >> shift;
+        mg += ((g << MEAN_SHIFT) - mg) >> shift;
+        mr += ((r << MEAN_SHIFT) - mr) >> shift;
+        _mean[matched][0][idx] = mb;
+        _mean[matched][1][idx] = mg;
+        _mean[matched][2][idx] = mr;
+        int db = b - (mb >> MEAN_SHIFT), dg = g - (mg >> MEAN_SHIFT),
+            dr = r - (mr >> MEAN_SHIFT);
+        // per channel variance: d2 / 3, in Q4
+        int sample_var = ((db * db + dg * dg + dr * dr) << VAR_SHIFT) / 3;
+        int var = _var[matched][idx];
+        var += (sample_var - var) >> shift;
+        _var[matched][idx] = std::max(VAR_MIN << VAR_SHIFT,
+                                      std::min(VAR_MAX << VAR_SHIFT, var));
+      }
+
+      // update the weights: w += alpha * (matched - w)
+      for (int mode = 0; mode < NMODES; ++mode) {
+        int w = _weight[mode][idx];
+        int target = (mode == matched ? 1 << WEIGHT_SHIFT : 0);
+        w += (target - w) >> shift;
+        // never let the matched mode be empty
+        if (mode == matched && w == 0)
+          w = 1;
+        _weight[mode][idx] = w;
+      } // end loop mode
+
+      // keep the modes sorted by decreasing weight
+      for (int mode = matched; mode > 0
+           && _weight[mode][idx] > _weight[mode - 1][idx]; --mode)
+        swap_modes(idx, mode, mode - 1);
+    } // end loop col
+  } // end process_row();
+
+  //////////////////////////////////////////////////////////////////////////////
+
+#ifdef COLOR_BACKGROUND_MODEL_PARALLEL
+  class RowUpdater : public cv::ParallelLoopBody {
+#else
+  class RowUpdater {
+#endif // COLOR_BACKGROUND_MODEL_PARALLEL
+  public:
+    RowUpdater(ColorBackgroundModel & model, const cv::Mat3b & frame,
+               cv::Mat1b & fg_mask, const cv::Mat1b* no_learn,
+               bool learn, int shift)
+      : _model(model), _frame(frame), _fg_mask(fg_mask), _no_learn(no_learn),
+        _learn(learn), _shift(shift) {}
+    void operator() (const cv::Range & range) const {
+      for (int row = range.start; row < range.end; ++row)
+        _model.process_row(row, _frame, _fg_mask, _no_learn, _learn, _shift);
+    }
+  private:
+    ColorBackgroundModel & _model;
+    const cv::Mat3b & _frame;
+    cv::Mat1b & _fg_mask;
+    const cv::Mat1b* _no_learn;
+    bool _learn;
+    int _shift;
+  }; // end class RowUpdater
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  int _learning_shift;
+  int _nframes;
+  cv::Size _size;
+  //! one plane per mode (and per channel), in the row-major pixel order
+  std::vector<unsigned short> _weight[NMODES];
+  std::vector<unsigned short> _var[NMODES];
+  std::vector<unsigned short> _mean[NMODES][3];
+}; // end class ColorBackgroundModel
+
+#endif // COLOR_BACKGROUND_MODEL_H
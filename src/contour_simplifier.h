@@ -0,0 +1,181 @@
+/*!
+  \file        contour_simplifier.h
+  \author      Arnaud Ramey <arnaud.a.ramey@gmail.com>
+                -- Robotics Lab, University Carlos III of Madrid
+  \date        2013/10/20
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+
+\class ContourSimplifier
+\brief Simplifies a set of contours into one list of points,
+with the label of the contour of each point.
+
+Two modes:
+  - DISTANCE_ANGLE: a single pass over each contour.
+    A point is dropped if it is closer than \a min_dist to the last kept point,
+    or if the angle (last kept point, point, next point) is flat,
+    i.e. closer than \a max_angle_deviation to PI.
+    The first and last points are always kept.
+  - DOUGLAS_PEUCKER: the points farther than \a epsilon
+    from the simplified polyline are kept.
+
+The output vectors are cleared but keep their memory between calls.
+
+ */
+
+#ifndef CONTOUR_SIMPLIFIER_H
+#define CONTOUR_SIMPLIFIER_H
+
+#include <vector>
+#include "geometry_utils.h"
+
+class ContourSimplifier {
+public:
+  enum Mode {
+    DISTANCE_ANGLE = 0,
+    DOUGLAS_PEUCKER = 1
+  };
+
+  /*!
+   * \param min_dist, max_angle_deviation
+   *    the criteria of DISTANCE_ANGLE, in pixels and radians
+   * \param epsilon
+   *    the tolerance of DOUGLAS_PEUCKER, in pixels
+   */
+  ContourSimplifier(const Mode mode = DISTANCE_ANGLE,
+                    const double min_dist = 15,
+                    const double max_angle_deviation = M_PI / 6,
+                    const double epsilon = 5)
+    : mode(mode), min_dist(min_dist),
+      max_angle_deviation(max_angle_deviation), epsilon(epsilon) {}
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * Simplify all the contours of at least \a min_size points.
+   * \param labels
+   *    if not NULL, the label of each contour, otherwise its index
+   * \param out, out_labels
+   *    the kept points of all contours, one after the other,
+   *    and the label of the contour of each point
+   */
+  template<class Point2>
+  void simplify(const std::vector<std::vector<Point2> > & contours,
+                const unsigned int min_size,
+                std::vector<Point2> & out, std::vector<int> & out_labels,
+                const std::vector<int>* labels = NULL) {
+    out.clear();
+    out_labels.clear();
+    for (unsigned int contour_idx = 0; contour_idx < contours.size(); ++contour_idx) {
+      const std::vector<Point2> & contour = contours[contour_idx];
+      if (contour.empty() || contour.size() < min_size)
+        continue;
+      unsigned int begin = out.size();
+      if (mode == DOUGLAS_PEUCKER)
+        simplify_douglas_peucker(contour, out);
+      else
+        simplify_distance_angle(contour, out);
+      out_labels.resize(out.size(), (labels ? (*labels)[contour_idx] : contour_idx));
+      maggieDebug3("contour %i: %i -> %i points", contour_idx,
+                   (int) contour.size(), (int) (out.size() - begin));
+    } // end loop contour_idx
+  } // end simplify();
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! append the DISTANCE_ANGLE simplification of \a contour to \a out
+  template<class Point2>
+  void simplify_distance_angle(const std::vector<Point2> & contour,
+                               std::vector<Point2> & out) const {
+    unsigned int npts = contour.size();
+    if (npts == 0)
+      return;
+    double min_dist_sq = min_dist * min_dist;
+    out.push_back(contour[0]);
+    for (unsigned int pt_idx = 1; pt_idx + 1 < npts; ++pt_idx) {
+      const Point2 & last_kept = out.back(), & pt = contour[pt_idx];
+      // minimum distance
+      if (geometry_utils::distance_points_squared(last_kept, pt) < min_dist_sq)
+        continue;
+      // open angle
+      double angle = geometry_utils::absolute_angle_between_three_points
+          (last_kept, pt, contour[pt_idx + 1]);
+      if (fabs(angle - M_PI) < max_angle_deviation)
+        continue;
+      out.push_back(pt);
+    } // end loop pt_idx
+    if (npts > 1)
+      out.push_back(contour.back());
+  } // end simplify_distance_angle();
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! append the DOUGLAS_PEUCKER simplification of \a contour to \a out
+  template<class Point2>
+  void simplify_douglas_peucker(const std::vector<Point2> & contour,
+                                std::vector<Point2> & out) {
+    unsigned int npts = contour.size();
+    if (npts <= 2) {
+      out.insert(out.end(), contour.begin(), contour.end());
+      return;
+    }
+    double epsilon_sq = epsilon * epsilon;
+    _keep.assign(npts, false);
+    _keep.front() = _keep.back() = true;
+    // the ranges [first, last] to process, without recursion
+    _stack.clear();
+    _stack.push_back(std::make_pair(0, npts - 1));
+    Point2 proj;
+    while (!_stack.empty()) {
+      int first = _stack.back().first, last = _stack.back().second;
+      _stack.pop_back();
+      const Point2 & a = contour[first], & b = contour[last];
+      bool degenerate = (a.x == b.x && a.y == b.y);
+      double max_dist_sq = -1;
+      int farthest = -1;
+      for (int pt_idx = first + 1; pt_idx < last; ++pt_idx) {
+        double dist_sq = (degenerate
+                          ? geometry_utils::distance_points_squared(contour[pt_idx], a)
+                          : geometry_utils::distance_point_segment_sq
+                            (contour[pt_idx], a, b, proj));
+        if (dist_sq > max_dist_sq) {
+          max_dist_sq = dist_sq;
+          farthest = pt_idx;
+        }
+      } // end loop pt_idx
+      if (farthest < 0 || max_dist_sq <= epsilon_sq)
+        continue;
+      _keep[farthest] = true;
+      _stack.push_back(std::make_pair(first, farthest));
+      _stack.push_back(std::make_pair(farthest, last));
+    } // end while (!_stack.empty())
+    for (unsigned int pt_idx = 0; pt_idx < npts; ++pt_idx)
+      if (_keep[pt_idx])
+        out.push_back(contour[pt_idx]);
+  } // end simplify_douglas_peucker();
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  Mode mode;
+  double min_dist, max_angle_deviation, epsilon;
+
+private:
+  std::vector<bool> _keep;
+  std::vector<std::pair<int, int> > _stack;
+}; // end class ContourSimplifier
+
+#endif // CONTOUR_SIMPLIFIER_H
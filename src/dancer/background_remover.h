@@ -24,6 +24,8 @@ ________________________________________________________________________________
 \brief A \a EffectInterface that removes the background thanks to
 some background learning method.
 
+The background is a per-pixel mixture of Gaussians of the colors
+(\a ColorBackgroundModel), continuously learnt where there is no user.
 No use of the depth is done.
  */
 
@@ -31,69 +33,58 @@ No use of the depth is done.
 #define BACKGROUND_REMOVER_H
 
 #include "effect_interface.h"
+#include "morph_utils.h"
+#include "color_background_model.h"
 
 // make virtual inheritance to avoid "the diamond of death"
 // http://en.wikipedia.org/wiki/Diamond_problem#The_diamond_problem
 class BackgroundRemover : virtual public EffectInterface {
 public:
-  BackgroundRemover() : threshold(30), learningRate(0.5), need_update(false) {}
+  //! the size of the margin around the users not learnt, in pixels
+  static const int USER_MARGIN = 15;
+
+  BackgroundRemover() : need_reset(false) {}
 
   //////////////////////////////////////////////////////////////////////////////
 
   void fn(const cv::Mat3b & color, const cv::Mat1f & depth, const cv::Mat1b & user,
           const kinect::NiteSkeletonList & skeleton_list,
           cv::Mat3b & img_out) {
-    substract_background(color, img_out);
-    if (need_update) {
-      need_update = false;
-      update_background(color);
+    if (need_reset) {
+      need_reset = false;
+      model.reset();
+    }
+    // do not learn the users, nor their blurry edges
+    if (!user.empty()) {
+      cv::threshold(user, no_learn_mask, 0, 255, CV_THRESH_BINARY);
+      morph.dilate_rect(no_learn_mask, no_learn_mask, USER_MARGIN, USER_MARGIN);
     }
+    else
+      no_learn_mask.release();
+    substract_background(color, img_out);
   } // end fn();
 
   //////////////////////////////////////////////////////////////////////////////
 
   void substract_background(const cv::Mat3b & frame, cv::Mat3b & frame_out) {
-    if (bg.empty()) {
-      frame_out.create(frame.size());
-      frame_out.setTo(0);
-      return;
-    }
-    cv::cvtColor(frame, frameBW, cv::COLOR_BGR2GRAY);
-    cv::absdiff(frameBW, bg, fg);
-    cv::threshold(fg, fg_thres, threshold, 255, cv::THRESH_BINARY);
-    cv::morphologyEx(fg_thres, fg_thres_morph, cv::MORPH_CLOSE, cv::Mat(15, 15, CV_8U, 255));
+    model.apply(frame, fg, no_learn_mask);
+    morph.close_rect(fg, fg_thres_morph, 15, 15);
     //cv::morphologyEx(fg_thres_morph, fg_thres_morph, cv::MORPH_OPEN, cv::Mat(15, 15, CV_8U, 255));
 
+    frame_out.create(frame.size());
     frame_out.setTo(0);
     frame.copyTo(frame_out, fg_thres_morph);
 
-    //  cv::imshow("bg", bg);
+    //  cv::Mat3b bg; model.get_background_image(bg); cv::imshow("bg", bg);
     //  cv::imshow("fg", fg);
-    //  cv::imshow("fg_thres", fg_thres);
     //  cv::imshow("fg_thres_morph", fg_thres_morph);
   }
 
   //////////////////////////////////////////////////////////////////////////////
 
-  // processing method
-  void update_background(const cv::Mat3b & frame) {
-    maggieDebug2("update_background()");
-    if (bg.empty()) {
-      cv::cvtColor(frame, bg, cv::COLOR_BGR2GRAY);
-      bg.convertTo(bg32, CV_32F);
-    }
-    else {
-      cv::cvtColor(frame, frameBW, cv::COLOR_BGR2GRAY);
-      // dst(x, y) = (1 - alpha) * dst(x, y) + alpha * src(x, y)  , if mask(x, y) != 0
-      cv::accumulateWeighted(frameBW, bg32, learningRate);
-    }
-    bg32.convertTo(bg, CV_8U);
-  } // end update_background();
-
-  //////////////////////////////////////////////////////////////////////////////
-
   void first_call() {
-    maggiePrint("Left click to updated model");
+    maggiePrint("The background is learnt continuously. "
+                "Left click to reset the model");
   }
 
   //////////////////////////////////////////////////////////////////////////////
@@ -101,18 +92,16 @@ public:
   //! custom mouse callback
   virtual void mouse_cb(int event, int x, int y) {
     if (event == CV_EVENT_LBUTTONDOWN)
-      need_update = true;
+      need_reset = true;
   } // end mouse_cb();
 
   //////////////////////////////////////////////////////////////////////////////
 
   const char* name() const { return "BackgroundRemover"; }
-  cv::Mat3b frameBW;
-  cv::Mat1b bg, fg, fg_thres, fg_thres_morph;
-  cv::Mat1f bg32;
-  int threshold;
-  double learningRate;
-  bool need_update;
+  ColorBackgroundModel model;
+  cv::Mat1b no_learn_mask, fg, fg_thres_morph;
+  image_utils::MaskMorphology morph;
+  bool need_reset;
 }; // end class BackgroundRemover
 
 #endif // BACKGROUND_REMOVER_H
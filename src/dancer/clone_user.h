@@ -20,7 +20,16 @@ You should have received a copy of the GNU Lesser General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ________________________________________________________________________________
 
-\todo Description of the file
+\class CloneUser
+\brief A \a EffectInterface that pastes copies of users at other positions.
+
+Each clone is composited at the depth of its user,
+with a z-buffer: clones behind a live user are hidden.
+The masks are built and pasted in the bounding box of each user.
+
+Optionally, time echoes show the users as they were
+echo_delay, 2 * echo_delay... seconds ago,
+from a \a UserCropHistory of the crops of the users.
 
  */
 
@@ -30,20 +39,16 @@ ________________________________________________________________________________
 #include "effect_interface.h"
 #include "drawing_utils.h"
 #include "copy_color_to_out_and_user_edge.h"
-
-cv::Point center_of_mass(const cv::Mat1b & user, const uchar & user_idx) {
-  long int sum_x = 0, sum_y = 0, sum_size = 0;
-  for (int row = 0; row < user.rows; ++row) {
-    const uchar* user_data = user.ptr<uchar>(row);
-    for (int col = 0; col < user.cols; ++col) {
-      if (*user_data++ != user_idx) {
-        sum_x += col;
-        sum_y += row;
-        ++sum_size;
-      }
-    } // end loop col
-  } // end loop row
-  return cv::Point(1.f * sum_x / sum_size, 1.f * sum_y / sum_size);
+#include "user_stats.h"
+#include "morph_utils.h"
+#include "user_crop_history.h"
+#include "timer.h"
+
+//! \return the center of mass of the user \a user_idx, from computed \a stats
+inline cv::Point center_of_mass(const UserStats & stats, const uchar & user_idx) {
+  if (!stats.has_user(user_idx))
+    return cv::Point(-1, -1);
+  return stats.get(user_idx).centroid;
 } // end center_of_mass()
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -56,7 +61,20 @@ public:
 
   //////////////////////////////////////////////////////////////////////////////
 
-  CloneUser() {
+  /*!
+   * \param nb_echoes
+   *    the number of time echoes of the users, 0 for none
+   * \param echo_delay
+   *    the delay between two echoes, in seconds
+   * \param max_fps
+   *    the max frame rate of the input, used to size the history.
+   *    If the input is faster, the oldest echoes are evicted too early
+   *    and come closer in time than \a echo_delay.
+   */
+  CloneUser(const int nb_echoes = 0, const double echo_delay = .5,
+            const int max_fps = 30)
+    : _nb_echoes(nb_echoes), _echo_delay(echo_delay),
+      _history(std::max(1, (int) std::ceil(nb_echoes * echo_delay * max_fps)) + 1) {
     reset_new_clone_data();
   }
 
@@ -123,19 +141,80 @@ public:
           const kinect::NiteSkeletonList & skeleton_list,
           cv::Mat3b & img_out) {
     color.copyTo(img_out);
+    if (clones.empty() && _nb_echoes == 0) {
+      process_new_clone_data(user, img_out);
+      return;
+    }
+    bool has_depth = (depth.size() == user.size());
+    stats.compute(user, (has_depth ? depth : cv::Mat1f()));
+
+    // the z-buffer: the depth of the live users, infinite elsewhere.
+    // The live users with no depth are at 0, so that they stay in front.
+    zbuffer.create(user.size());
+    zbuffer.setTo(std::numeric_limits<float>::infinity());
+    cv::Rect live_roi = stats.bbox_union();
+    for (int row = live_roi.y; row < live_roi.y + live_roi.height; ++row) {
+      const uchar* user_data = user.ptr<uchar>(row);
+      const float* depth_data = (has_depth ? depth.ptr<float>(row) : NULL);
+      float* z_data = zbuffer.ptr<float>(row);
+      for (int col = live_roi.x; col < live_roi.x + live_roi.width; ++col) {
+        if (user_data[col] == 0)
+          continue;
+        if (depth_data && !image_utils::is_nan_depth(depth_data[col]))
+          z_data[col] = depth_data[col];
+        else
+          z_data[col] = 0;
+      } // end loop col
+    } // end loop row
+
+    // store the users and paste their echoes, most recent first
+    if (_nb_echoes > 0) {
+      double now = _clock.getTimeSeconds();
+      if (live_roi.width > 0)
+        _history.push(now, live_roi, color, user, depth);
+      for (int echo_idx = 1; echo_idx <= _nb_echoes; ++echo_idx)
+        paste_echo(now - echo_idx * _echo_delay, img_out);
+    }
 
-    // make the clones
+    // make the clones, each at the depth of its user
     for (CloneMap::iterator it = clones.begin() ; it != clones.end() ; ++it) {
-      if (it->second.size() == 0)
+      if (it->second.size() == 0 || !stats.has_user(it->first))
         continue;
-      user_mask = (user == it->first);
+      const UserStats::Stats & user_stats = stats.get(it->first);
+      // grow the bbox by the erosion radius, so that the border is eroded
+      cv::Rect roi(user_stats.bbox.x - 1, user_stats.bbox.y - 1,
+                   user_stats.bbox.width + 2, user_stats.bbox.height + 2);
+      roi &= cv::Rect(0, 0, user.cols, user.rows);
+      user_mask = (user(roi) == it->first);
       // smooth mask
-      cv::erode(user_mask, user_mask, cv::Mat(3, 3, CV_8U, 255));
-      //cv::morphologyEx(user_mask, user_mask, cv::MORPH_OPEN, cv::Mat(5, 5, CV_8U, 255));
+      morph.erode_rect(user_mask, user_mask, 3, 3);
+      // the depth of the user pixels with no depth:
+      // behind everything else if the user has no depth at all
+      float default_z = (user_stats.depth_count > 0 ? user_stats.depth_median
+                                                    : std::numeric_limits<float>::max());
 
       for (uint transl_idx = 0; transl_idx < it->second.size(); ++transl_idx) {
         cv::Point transl = it->second[transl_idx];
-        image_utils::paste_img(color, img_out, transl.x, transl.y, &user_mask);
+        // the part of the roi that lands in the image
+        cv::Rect src_roi = roi & cv::Rect(-transl.x, -transl.y, user.cols, user.rows);
+        for (int row = src_roi.y; row < src_roi.y + src_roi.height; ++row) {
+          const uchar* mask_data = user_mask.ptr<uchar>(row - roi.y) - roi.x;
+          const cv::Vec3b* src_data = color.ptr<cv::Vec3b>(row);
+          const float* depth_data = (has_depth ? depth.ptr<float>(row) : NULL);
+          cv::Vec3b* dst_data = img_out.ptr<cv::Vec3b>(row + transl.y) + transl.x;
+          float* z_data = zbuffer.ptr<float>(row + transl.y) + transl.x;
+          for (int col = src_roi.x; col < src_roi.x + src_roi.width; ++col) {
+            if (mask_data[col] == 0)
+              continue;
+            float z = default_z;
+            if (depth_data && !image_utils::is_nan_depth(depth_data[col]))
+              z = depth_data[col];
+            if (z > z_data[col]) // behind a live user or a closer clone
+              continue;
+            z_data[col] = z;
+            dst_data[col] = src_data[col];
+          } // end loop col
+        } // end loop row
       } // end loop transl_idx
     } // end loop it
 
@@ -145,6 +224,35 @@ public:
 
   //////////////////////////////////////////////////////////////////////////////
 
+  //! paste the users of time \a timestamp where they are not hidden
+  void paste_echo(const double timestamp, cv::Mat3b & img_out) {
+    cv::Rect roi;
+    // no echo of the users that were not seen around that time,
+    // for instance before the effect was switched away and back
+    if (!_history.get(timestamp, roi, _echo_color, _echo_user, _echo_depth,
+                      _echo_delay))
+      return;
+    for (int row = 0; row < roi.height; ++row) {
+      const uchar* user_data = _echo_user.ptr<uchar>(row);
+      const cv::Vec3b* src_data = _echo_color.ptr<cv::Vec3b>(row);
+      const unsigned short* depth_data = _echo_depth.ptr<unsigned short>(row);
+      cv::Vec3b* dst_data = img_out.ptr<cv::Vec3b>(roi.y + row) + roi.x;
+      float* z_data = zbuffer.ptr<float>(roi.y + row) + roi.x;
+      for (int col = 0; col < roi.width; ++col) {
+        if (user_data[col] == 0)
+          continue;
+        float z = depth_data[col] / 1000.f;
+        // at equal depth, the live user and the newer echoes stay in front
+        if (z >= z_data[col])
+          continue;
+        z_data[col] = z;
+        dst_data[col] = src_data[col];
+      } // end loop col
+    } // end loop row
+  } // end paste_echo();
+
+  //////////////////////////////////////////////////////////////////////////////
+
   //! custom mouse callback
   virtual void mouse_cb(int event, int x, int y) {
     maggieDebug3("mouse_cb(event:%i, x:%i, y:%i)", event, x, y);
@@ -165,7 +273,21 @@ public:
   CloneMap clones;
   cv::Point new_clone_idx_pos, new_clone_pos;
   uchar new_clone_idx;
-  cv::Mat user_mask;
+  //! the eroded mask of a cloned user, in its bounding box
+  cv::Mat1b user_mask;
+  image_utils::MaskMorphology morph;
+  UserStats stats;
+  //! the depth of the front-most live user or clone of each pixel
+  cv::Mat1f zbuffer;
+  int _nb_echoes;
+  double _echo_delay;
+  //! the past crops of the users, for the echoes
+  UserCropHistory _history;
+  Timer _clock;
+  //! headers on the crop of an echo
+  cv::Mat3b _echo_color;
+  cv::Mat1b _echo_user;
+  cv::Mat1w _echo_depth;
 }; // end class CloneUser
 
 #endif // CLONE_USER_H
@@ -33,6 +33,9 @@ ________________________________________________________________________________
 #include <opencv2/imgproc/imgproc.hpp>
 #include "geometry_utils.h"
 #include "drawing_utils.h"
+#include "nan_handling.h"
+#include "segment_grid.h"
+#include "contour_simplifier.h"
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -47,26 +50,14 @@ public:
   ComputeUserAccelerations() :
     draw_img_flag(true) {}
 
-  static void simplify_contour(std::vector<cv::Point> & contour) {
-    for (unsigned int pt_idx = 0; pt_idx < contour.size() - 2; ++pt_idx) {
-      bool need_delete = false;
-      // minimum distance
-      if (geometry_utils::distance_points_squared(contour[pt_idx], contour[pt_idx + 1])
-          < 15 * 15)
-        need_delete = true;
-      else {
-        // open angle
-        double angle = geometry_utils::absolute_angle_between_three_points
-            (contour[pt_idx], contour[pt_idx + 1], contour[pt_idx + 2]);
-        if (fabs(angle - M_PI) < M_PI / 6)
-          need_delete = true;
-      }
+  //////////////////////////////////////////////////////////////////////////////
 
-      if (need_delete) { // remove pt_idx + 1
-        contour.erase(contour.begin() + pt_idx + 1);
-        pt_idx--; // rewind
-      }
-    } // end loop pt
+  //! simplify one contour in place, with the default criteria
+  static void simplify_contour(std::vector<cv::Point> & contour) {
+    std::vector<cv::Point> simplified;
+    simplified.reserve(contour.size());
+    ContourSimplifier().simplify_distance_angle(contour, simplified);
+    contour.swap(simplified);
   } // end simplify_contour();
 
   //////////////////////////////////////////////////////////////////////////////
@@ -77,8 +68,6 @@ public:
     // reset variables
     img_out.create(color.size());
     contours.clear();
-    concatenated_contour.clear();
-    simplified_contour.clear();
     accelerations.clear();
 
     // find contours of user of interest
@@ -90,52 +79,46 @@ public:
                      CV_CHAIN_APPROX_TC89_L1
                      ); // all pixels of each contours
 
-    if (contours.size() == 0) { // no contours -> do nothing
-      draw_img_out(img_out);
-      return;
-    }
-
-    // concatenate all contours
-    // first determine the size of the concatenated_contour
-    int concatenated_contour_size = 0;
-    for (unsigned int contour_idx = 0; contour_idx < contours.size(); ++contour_idx)
-      concatenated_contour_size += contours[contour_idx].size();
-    concatenated_contour.clear();
-    concatenated_contour.reserve(concatenated_contour_size);
-    // then really add points
-    for (unsigned int contour_idx = 0; contour_idx < contours.size(); ++contour_idx) {
-      // do not insert if contour to small
-      if (contours[contour_idx].size() < MIN_CONTOUR_SIZE)
-        continue;
-      concatenated_contour.insert
-          (concatenated_contour.end(),
-           contours[contour_idx].begin(), contours[contour_idx].end());
-    }
-    maggieDebug3("concatenated_contour of size %i", concatenated_contour.size());
-
-    // simplify contour
-    //cv::approxPolyDP(cv::Mat(concatenated_contour), simplified_contour, 5, false);
-    simplified_contour = concatenated_contour;
-    simplify_contour(simplified_contour);
+    // simplify contours, skipping the too small ones
+    // (ContourSimplifier::DOUGLAS_PEUCKER for a cv::approxPolyDP()-like result)
+    simplifier.simplify(contours, MIN_CONTOUR_SIZE,
+                        simplified_contour, simplified_contour_indices);
+    // label each point with its user, the contour pixels being in the user:
+    // a contour around touching users has points of several users
+    simplified_contour_users.resize(simplified_contour.size());
+    for (unsigned int pt_idx = 0; pt_idx < simplified_contour.size(); ++pt_idx)
+      simplified_contour_users[pt_idx] = user(simplified_contour[pt_idx]);
     if (simplified_contour.size() == 0) {
-      maggiePrint("simplified_contour.size() == 0");
+      maggieDebug3("simplified_contour.size() == 0");
+      previous_simplified_contour.clear();
       draw_img_out(img_out);
       return;
     }
-    maggieDebug3("approxPolyDP size %i -> %i",
-                      concatenated_contour.size(), simplified_contour.size());
+    maggieDebug3("simplified_contour of size %i", simplified_contour.size());
 
     // do not determine accelerations if previous_simplified_contour empty
     if (previous_simplified_contour.size() == 0) {
       previous_simplified_contour = simplified_contour;
+      previous_simplified_contour_indices = simplified_contour_indices;
+      previous_simplified_contour_users = simplified_contour_users;
       draw_img_out(img_out);
       return;
     }
 
     // determine accelerations
+    // the different contours are not linked, the queries are made by user
+    previous_contour_grid.build(previous_simplified_contour, false,
+                                &previous_simplified_contour_indices,
+                                &previous_simplified_contour_users);
     cv::Point* curr_pt = &(simplified_contour[0]);
     for (unsigned int curr_pt_idx = 0; curr_pt_idx < simplified_contour.size(); ++curr_pt_idx) {
       double curr_depth = depth(*curr_pt);
+      // the contour points are on the user silhouette: a filled depth
+      // would be the one of the background, so skip the holes instead
+      if (image_utils::is_nan_depth(curr_depth)) {
+        ++curr_pt;
+        continue;
+      }
       // find the closest point from the previous_simplified_contour
       cv::Point closest_prev_pt;
 #if 0
@@ -151,9 +134,13 @@ public:
         ++prev_pt;
       } // end loop prev_pt_idx
 #else
+      // only compare with the previous contour of the same user
       double min_dist_sq;
-      geometry_utils::distance_point_polygon_squared
-          (*curr_pt, previous_simplified_contour, closest_prev_pt, min_dist_sq, false);
+      if (!previous_contour_grid.query(*curr_pt, closest_prev_pt, min_dist_sq,
+                                       simplified_contour_users[curr_pt_idx])) {
+        ++curr_pt;
+        continue;
+      }
 #endif
 
       // now that we have the closest point from previous_simplified_contour
@@ -174,6 +161,8 @@ public:
 
     // store previous_simplified_contour
     previous_simplified_contour = simplified_contour;
+    previous_simplified_contour_indices = simplified_contour_indices;
+    previous_simplified_contour_users = simplified_contour_users;
 
     draw_img_out(img_out);
   } // end fn();
@@ -187,8 +176,11 @@ public:
     // clear img_out
     img_out.setTo(0);
 
-    // draw concatenated_contour
-    image_utils::drawListOfPoints(img_out, concatenated_contour, cv::Vec3b(255, 255, 255));
+    // draw contours
+    for (unsigned int contour_idx = 0; contour_idx < contours.size(); ++contour_idx) {
+      if (contours[contour_idx].size() >= MIN_CONTOUR_SIZE)
+        image_utils::drawListOfPoints(img_out, contours[contour_idx], cv::Vec3b(255, 255, 255));
+    }
     //    cv::drawContours(img_out, contours, -1, // draw all contours
     //                     cv::Scalar::all(255), // in white
     //                     2); // with a thickness of 2
@@ -220,9 +212,14 @@ public:
   const char* name() const { return "ComputeUserAccelerations"; }
 
   std::vector<std::vector<cv::Point> > contours;
-  std::vector<cv::Point> concatenated_contour;
+  ContourSimplifier simplifier;
+  //! the simplified points of all contours, the contour and the user of each point
   std::vector<cv::Point> simplified_contour;
+  std::vector<int> simplified_contour_indices, simplified_contour_users;
   std::vector<cv::Point> previous_simplified_contour;
+  std::vector<int> previous_simplified_contour_indices, previous_simplified_contour_users;
+  //! the segments of previous_simplified_contour, for the closest point queries
+  geometry_utils::SegmentGrid<cv::Point> previous_contour_grid;
   cv::Mat1b user_mask;
 
   struct Acceleration {
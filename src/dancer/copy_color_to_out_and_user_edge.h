@@ -32,12 +32,23 @@ and draws the edge of the user index.
 #include "effect_interface.h"
 #include "skeleton_utils.h"
 #include "color_utils.h"
+#include "user_stats.h"
 
+/*!
+ * draw the edges of the users whose index is in [min_user_idx, max_user_idx]
+ * \param stats
+ *    if not NULL, the stats computed on \a user:
+ *    only the bounding boxes of the users are scanned
+ */
 void draw_users_contour(const cv::Mat1b & user,
                         const uchar & min_user_idx, const uchar & max_user_idx,
-                        cv::Mat3b & img_out) {
+                        cv::Mat3b & img_out,
+                        const UserStats* stats = NULL) {
+  cv::Rect roi(0, 0, img_out.cols, img_out.rows);
+  if (stats != NULL)
+    roi &= stats->bbox_union(min_user_idx, max_user_idx);
   uchar user_r, user_g, user_b;
-  for (int row = 0; row < img_out.rows; ++row) {
+  for (int row = roi.y; row < roi.y + roi.height; ++row) {
     // get the address of row
     const uchar* user_data      = user.ptr<uchar>(row);
     const uchar* user_data_up   = (row > 0 ?
@@ -45,8 +56,8 @@ void draw_users_contour(const cv::Mat1b & user,
     const uchar* user_data_down = (row < img_out.rows - 1 ?
                                      user.ptr<uchar>(row + 1) : NULL);
     // uchar* out_data = img_out.ptr<uchar>(row);
-    for (int col = 0; col < img_out.cols; ++col) {
-      if (user_data[col] < min_user_idx || user_data[max_user_idx] > max_user_idx)
+    for (int col = roi.x; col < roi.x + roi.width; ++col) {
+      if (user_data[col] < min_user_idx || user_data[col] > max_user_idx)
         continue;
       if (   (col > 0               && user_data[col] != user_data[col - 1])
              || (col < img_out.cols -1 && user_data[col] != user_data[col + 1])
@@ -77,11 +88,13 @@ public:
           const kinect::NiteSkeletonList & skeleton_list,
           cv::Mat3b & img_out) {
     color.copyTo(img_out);
-    draw_users_contour(user, 1, 255, img_out);
+    stats.compute(user);
+    draw_users_contour(user, 1, 255, img_out, &stats);
     skeleton_utils::draw_skeleton_list(img_out, skeleton_list, 2);
   } // end fn();
 
   const char* name() const { return "CopyColorToOutAndUserEdge"; }
+  UserStats stats;
 }; // end class CopyColorToOutAndUserEdge
 
 #endif // COPY_COLOR_TO_OUT_AND_USER_EDGE_H
@@ -32,6 +32,9 @@ ________________________________________________________________________________
 #include "copy_user_to_out.h"
 #include "copy_depth_to_out.h"
 #include "keep_only_user_color_background.h"
+#include "disjoint_sets2.h"
+#include "blob_tracker.h"
+#include "morph_utils.h"
 
 // make virtual inheritance to avoid "the diamond of death"
 // http://en.wikipedia.org/wiki/Diamond_problem#The_diamond_problem
@@ -45,6 +48,10 @@ public:
   /*! the difference between a pixel depth and the background depth
   in meters to be considered as foreground */
   static const double FOREGROUND_MIN_DEPTH_RATIO = .9;
+  //! the number of bands labelled in parallel
+  static const int NB_LABELLING_BLOCKS = 4;
+  //! the smaller blobs, in pixels, are not labelled
+  static const int MIN_BLOB_SIZE = 200;
 
   //! ctor
   DepthBackgroundRemover()
@@ -75,7 +82,14 @@ public:
       ++background_ptr;
       ++fake_user_ptr;
     } // end loop pixel_idx
-    cv::morphologyEx(fake_user, fake_user, cv::MORPH_OPEN, cv::Mat(10, 10, CV_8U, 255));
+    morph.open_rect(fake_user, fake_user, 10, 10);
+
+    // label the foreground blobs and give them stable IDs across frames
+    set.process_image_runs(fake_user, NB_LABELLING_BLOCKS);
+    set.get_labels(fake_user, MIN_BLOB_SIZE);
+    stats.compute(fake_user, depth);
+    tracker.update(stats);
+    tracker.relabel(fake_user);
 
     // now, some funny processing
     // do not do it as it will be done by the successive filters
@@ -100,6 +114,12 @@ public:
   cv::Mat1f background;
   cv::Mat1f foreground;
   cv::Mat1b fake_user;
+
+protected:
+  image_utils::MaskMorphology morph;
+  DisjointSets2 set;
+  UserStats stats;
+  BlobTracker tracker;
 }; // end class DepthBackgroundRemover
 
 #endif // DEPTH_BACKGROUND_REMOVER_H
@@ -62,16 +62,20 @@ void EffectCollection::add_all_effects() {
   effects.push_back(new KeepOnlyUserColorBackground(cv::Vec3b(0, 0, 0)));
   effects.push_back(new KeepOnlyUserColorBackground(cv::Vec3b(255, 255, 255)));
   // effects.push_back(new KeepOnlyUserVideoBackground(NITE_FX_PATH "video_backgrounds/blue_lines.m4v"));
-  effects.push_back(new KeepOnlyUserVideoBackground(NITE_FX_PATH "video_backgrounds/news.m4v"));
+  // short clip: decode it once into a frame cache
+  effects.push_back(new KeepOnlyUserVideoBackground
+                    (NITE_FX_PATH "video_backgrounds/news.m4v", true));
 
   effects.push_back(new SetUserToBlack());
   effects.push_back(new RemoveUserQuickFill());
   effects.push_back(new RemoveUserInPaint());
   effects.push_back(new RemoveUserInPaintScale());
   effects.push_back(new CloneUser());
+  effects.push_back(new CloneUser(4, .5)); // time echoes
   effects.push_back(new BackgroundRemover());
   effects.push_back(new ComputeUserAccelerations());
   effects.push_back(new ParticleThrower());
+  effects.push_back(new ParticleThrower(ParticleThrower::EMIT_FROM_JOINTS));
   effects.push_back(new Blur());
   effects.push_back(new Helices());
   // end of effect interfaces instantiations
@@ -37,6 +37,10 @@ Can also change the way users are detected.
 #include <opencv2/imgproc/imgproc.hpp>
 #include "timer.h"
 #include "drawing_utils.h"
+#include "depth_hole_filler.h"
+#include "rgbd_sequence.h"
+#include "mask_stabilizer.h"
+#include "ltm_path.h"
 
 #include "effect_interface.h"
 // possible effects for user detection
@@ -53,6 +57,7 @@ public:
     _curr_effect_idx = 0;
     _curr_user_detection_effect = USER_DETECTION_NITE;
     _resize_scale = 1;
+    _stabilize_user = false;
     window_name = "nite_foo_receiver";
 
     // get params
@@ -73,7 +78,9 @@ public:
                 effects[_curr_effect_idx]->name(), _resize_scale);
     maggiePrint("Press SPACE or 'n' for next FX, "
                 "backspace or 'p' for previous FX, "
-                "'u' to change user detection algorithm");
+                "'u' to change user detection algorithm, "
+                "'r' to start / stop recording the inputs, "
+                "'s' to toggle the user map stabilization");
 
     image_out.create(1, 1);
     cv::namedWindow(window_name);
@@ -103,29 +110,37 @@ public:
     maggieDebug3("fn() - user detection effect:%i, fn:%s",
                       _curr_user_detection_effect,
                       effects[_curr_effect_idx]->name());
+    // record the raw inputs, for user_detection_benchmark
+    if (_recorder.is_open())
+      _recorder.write(color, depth, user);
     Timer timer;
-    // user detection and call the effect
-    if (_curr_user_detection_effect == USER_DETECTION_NITE) {
-      effects[_curr_effect_idx]->fn(color, depth, user, skeleton_list, image_out);
-    }
-    else if (_curr_user_detection_effect == USER_DETECTION_DEPTH_BLOB) {
-     get_depth_blobs_effect.fn
-         (color, depth, user, skeleton_list, image_out);
-     maggieDebug3("time for user detectop, with GetDepthBlobs: %g ms",
-                       timer.getTimeMilliseconds());
-      effects[_curr_effect_idx]->fn
-          (color, depth, get_depth_blobs_effect.fake_user, skeleton_list,
-           image_out);
+    // fill the depth holes only if the effect needs it
+    const cv::Mat1f & effect_depth =
+        (effects[_curr_effect_idx]->needs_filled_depth() ? filled_depth(depth) : depth);
+    // user detection
+    const cv::Mat1b* detected_user = &user;
+    if (_curr_user_detection_effect == USER_DETECTION_DEPTH_BLOB) {
+      get_depth_blobs_effect.fn
+          (color, depth, user, skeleton_list, image_out);
+      maggieDebug3("time for user detectop, with GetDepthBlobs: %g ms",
+                   timer.getTimeMilliseconds());
+      detected_user = &get_depth_blobs_effect.fake_user;
     }
     else if (_curr_user_detection_effect == USER_DETECTION_DEPTH_BACKGROUND_REMOVER) {
       depth_bacground_remover_effect.fn
           (color, depth, user, skeleton_list, image_out);
       maggieDebug3("time for user detectop, with DepthBackgroundRemover: %g ms",
-                        timer.getTimeMilliseconds());
-      effects[_curr_effect_idx]->fn
-          (color, depth, depth_bacground_remover_effect.fake_user, skeleton_list,
-           image_out);
+                   timer.getTimeMilliseconds());
+      detected_user = &depth_bacground_remover_effect.fake_user;
+    }
+    // remove the flicker of the user map
+    if (_stabilize_user) {
+      _mask_stabilizer.apply(*detected_user, _stabilized_user);
+      detected_user = &_stabilized_user;
     }
+    // call the effect
+    effects[_curr_effect_idx]->fn
+        (color, effect_depth, *detected_user, skeleton_list, image_out);
 
     maggieDebug3("time for effect fn: %g ms", timer.getTimeMilliseconds());
 
@@ -162,15 +177,27 @@ public:
         _curr_user_detection_effect = USER_DETECTION_DEPTH_BACKGROUND_REMOVER;
       else if (_curr_user_detection_effect == USER_DETECTION_DEPTH_BACKGROUND_REMOVER)
         _curr_user_detection_effect = USER_DETECTION_NITE;
+      _mask_stabilizer.reset(); // the labels of the new detector are different
       maggiePrint("Using user_detection_effect '%s'",
                   user_detection_effect_to_string(_curr_user_detection_effect).c_str());
     }
-    else if ((int) c == 27)
+    else if (c == 's') { // toggle the user map stabilization
+      _stabilize_user = !_stabilize_user;
+      _mask_stabilizer.reset();
+      maggiePrint("User map stabilization: %s", (_stabilize_user ? "on" : "off"));
+    }
+    else if (c == 'r') // start / stop recording
+      toggle_recording();
+    else if ((int) c == 27) {
+      // write the queued frames of the recording before leaving
+      if (_recorder.is_open())
+        toggle_recording();
 #ifdef NITE_FX
       exit(0);
 #else // not NITE_FX
       ros::shutdown();
 #endif // not NITE_FX
+    }
   } // end image_callback();
 
   //////////////////////////////////////////////////////////////////////////////
@@ -191,6 +218,28 @@ public:
   }
 
 private:
+  //! start recording in a new folder, or stop the current recording
+  void toggle_recording() {
+    if (_recorder.is_open()) {
+      _recorder.close();
+      maggiePrint("Stopped recording: %i frames in '%s'",
+                  _recorder.nframes(), _recorder.folder().c_str());
+      return;
+    }
+    std::ostringstream folder;
+    folder << LONG_TERM_MEMORY_DIR << "record_" << time(NULL);
+    if (_recorder.open(folder.str()))
+      maggiePrint("Recording in '%s'", folder.str().c_str());
+  }
+
+  //! \return \a depth with its holes filled
+  inline const cv::Mat1f & filled_depth(const cv::Mat1f & depth) {
+    Timer timer;
+    _depth_hole_filler.fill(depth, _filled_depth);
+    maggieDebug3("time for depth hole filling: %g ms", timer.getTimeMilliseconds());
+    return _filled_depth;
+  }
+
   //! the list of all possible effects
   std::vector<EffectInterface*> effects;
   //! the index of the active effect
@@ -223,6 +272,15 @@ private:
   //! the list of all possible effects
   GetDepthBlobs get_depth_blobs_effect;
   DepthBackgroundRemover depth_bacground_remover_effect;
+  //! the depth without holes, for the effects that need it
+  DepthHoleFiller<float> _depth_hole_filler;
+  cv::Mat1f _filled_depth;
+  //! records the inputs when active
+  rgbd_sequence::Writer _recorder;
+  //! the optional temporal stabilization of the user map
+  bool _stabilize_user;
+  MaskStabilizer _mask_stabilizer;
+  cv::Mat1b _stabilized_user;
 }; // end class EffectCollection
 
 #endif // EFFECT_COLLECTION_H
@@ -46,6 +46,11 @@ public:
    cv::Mat3b & img_out)
   = 0;
 
+  /*! inherit this function to receive in fn() a depth image
+      without holes (cf. DepthHoleFiller).
+      The holes take the background depth: not for the user pixels. */
+  virtual bool needs_filled_depth() const { return false; }
+
   //! a generic mouse callback that call be inherited
   virtual void mouse_cb(int event, int x, int y) {
     // maggieDebug2("mouse_cb(event:%i, x:%i, y:%i)", event, x, y);
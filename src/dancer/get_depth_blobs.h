@@ -22,7 +22,7 @@ ________________________________________________________________________________
 
 \class GetDepthBlobs
 \brief A \a EffectInterface that finds users by keeping all depth pixels that are
-not undefined (NaN).
+not undefined (NaN) and above the floor (\a FloorPlaneEstimator).
 
  */
 
@@ -31,6 +31,9 @@ not undefined (NaN).
 
 #include "effect_interface.h"
 #include "disjoint_sets2.h"
+#include "blob_tracker.h"
+#include "morph_utils.h"
+#include "floor_plane_estimator.h"
 #include "drawing_utils.h"
 #include "copy_user_to_out.h"
 
@@ -38,25 +41,26 @@ not undefined (NaN).
 // http://en.wikipedia.org/wiki/Diamond_problem#The_diamond_problem
 class GetDepthBlobs : virtual public EffectInterface {
 public:
+  //! the number of bands labelled in parallel
+  static const int NB_LABELLING_BLOCKS = 4;
+  //! the smaller blobs, in pixels, are not labelled
+  static const int MIN_BLOB_SIZE = 200;
+
   void fn(const cv::Mat3b & color, const cv::Mat1f & depth, const cv::Mat1b & user,
           const kinect::NiteSkeletonList & skeleton_list,
           cv::Mat3b & img_out) {
     // find connected components
-    depth_mask = (depth != 0);
-    cv::morphologyEx(depth_mask, depth_mask, cv::MORPH_OPEN, cv::Mat(5, 5, CV_8U, 255));
-#if 0
-    set.process_image(depth_mask);
-    set.get_connected_components(depth.cols, components_pts, bounding_boxes);
-
-    // paint them
-    fake_user.create(user.size());
-    fake_user = 0;
-    for (unsigned int comp_idx = 0; comp_idx < components_pts.size(); ++comp_idx)
-      image_utils::drawListOfPoints
-          (fake_user, components_pts[comp_idx], (uchar) (1 + comp_idx));
-#else
-    depth_mask.copyTo(fake_user);
-#endif
+    // keep the defined depth, above the floor
+    floor.update(depth);
+    floor.above_floor_mask(depth, depth_mask);
+    morph.open_rect(depth_mask, depth_mask, 5, 5);
+    // label them with runs: no per-pixel point vectors
+    set.process_image_runs(depth_mask, NB_LABELLING_BLOCKS);
+    set.get_labels(fake_user, MIN_BLOB_SIZE);
+    // give them stable IDs across frames
+    stats.compute(fake_user, depth);
+    tracker.update(stats);
+    tracker.relabel(fake_user);
   } // end fn();
 
   const char* name() const { return "GetDepthBlobs"; }
@@ -66,9 +70,11 @@ public:
 
 protected:
   cv::Mat1b depth_mask;
+  FloorPlaneEstimator floor;
+  image_utils::MaskMorphology morph;
   DisjointSets2 set;
-  std::vector< std::vector<cv::Point> > components_pts;
-  std::vector<cv::Rect> bounding_boxes;
+  UserStats stats;
+  BlobTracker tracker;
 
 }; // end class GetDepthBlobs
 
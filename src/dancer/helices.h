@@ -23,6 +23,11 @@ ________________________________________________________________________________
 \class Helices
 \brief A \a EffectInterface that simply copies the Kinect RGB image to the ouput image.
 
+The helices are stored as a structure of arrays (center, angle, speed),
+all updated with the same frame time.
+They are drawn from an atlas of the anti-aliased bar
+pre-rendered at ATLAS_ANGLES angles, blended pixel by pixel.
+
  */
 
 #ifndef HELICES_H
@@ -30,7 +35,7 @@ ________________________________________________________________________________
 
 #include <math.h>
 
-#include <deque>
+#include <vector>
 #include "timer.h"
 #include "copy_color_to_out_and_user_edge.h"
 #include "effect_interface.h"
@@ -46,82 +51,16 @@ public:
   static const float ANG_SPEED_MAX = 15;
   static const float ANG_SPEED_IDLE = .8;
 
-  //////////////////////////////////////////////////////////////////////////////
-  //////////////////////////////////////////////////////////////////////////////
-
-  class Helix {
-  public:
-    Helix(const cv::Point center, const float angle, const float angspeed = 0) :
-      _center(center), _angle(angle), _angspeed(angspeed), _idle_color(255, 50, 50) {
-      _color = _idle_color;
-    }
-
-    ////////////////////////////////////////////////////////////////////////////
-
-    inline void set_color(const cv::Scalar & newcol) {
-      // _color = newcol;
-    }
-
-    void refresh_angle(const cv::Mat1b & user,
-                       const float & shared_angle_2pi) {
-      // update angle
-      _angle += _last_refresh.getTimeSeconds() * _angspeed;
-      _last_refresh.reset();
-
-      // change speed according to user mask
-      if (user.at<uchar>(_center)) {
-        _angspeed = std::min(ANG_SPEED_MAX, _angspeed + ANG_SPEED_INCR);
-        set_color(CV_RGB(255, 0, 0)); // red
-      }
-
-      // otherwise (slower than ANG_SPEED_IDLE), set to ANG_SPEED_IDLE
-      else if (_angspeed <= ANG_SPEED_IDLE){
-        set_color(_idle_color); // blue
-        _angle = shared_angle_2pi;
-        _angspeed = ANG_SPEED_IDLE;
-      } // end if not user
-
-      // if slightly faster than ANG_SPEED_IDLE,
-      else if (_angspeed <= ANG_SPEED_IDLE + 3 * ANG_SPEED_DECR) {
-        // keep this speed till being close to shared_angle
-        set_color(CV_RGB(0, 255, 0)); // green
-        _angspeed = ANG_SPEED_IDLE + 2 * ANG_SPEED_DECR; // slowdown speed
-        // close enough, ie _angle ~= shared_angle + n PI
-        // <=> fmod( _angle - shared_angle, PI ) ~= 0
-        // -> set _angle to shared_angle
-        if (fmod(_angle - shared_angle_2pi, M_PI) < .3) {
-          _angle = shared_angle_2pi;
-          _angspeed = ANG_SPEED_IDLE;
-        }
-      } // end if slightly faster than ANG_SPEED_IDLE
-
-      // if a lot faster, decrease speed
-      else /*if (_angspeed > ANG_SPEED_IDLE + ANG_SPEED_DECR)*/ {
-        set_color(CV_RGB(255, 255, 0)); // orange
-        _angspeed = std::max((float) 0, _angspeed - ANG_SPEED_DECR);
-      }
-    } // end refresh_angle();
-
-    ////////////////////////////////////////////////////////////////////////////
+  //! the half length of a helix, in pixels
+  static const int RADIUS = 15;
+  //! the number of pre-rendered angles in [0, PI) (a helix is symmetric)
+  static const int ATLAS_ANGLES = 64;
 
-    void draw_on(cv::Mat3b & img) {
-      float cosa = cos(_angle) * radius, sina = sin(_angle) * radius;
-      cv::Point end1(_center.x + cosa, _center.y + sina),
-          end2(_center.x - cosa, _center.y - sina);
-      cv::line(img, end1, end2, _color, 2, CV_AA);
-      // cv::line(img, end1, _center, _color, 2);
-    }
-
-    ////////////////////////////////////////////////////////////////////////////
+  //////////////////////////////////////////////////////////////////////////////
 
-    cv::Point _center;
-    float _angle;
-    static const int radius = 15;
-    float _angspeed;
-    Timer _last_refresh;
-    cv::Scalar _color;
-    cv::Scalar _idle_color;
-  }; // end class Helix
+  Helices() : _color(255, 50, 50) {
+    build_atlas();
+  }
 
   //////////////////////////////////////////////////////////////////////////////
 
@@ -133,31 +72,153 @@ public:
     float shared_angle_2pi = // shared_angle - TWOPI * (int) (shared_angle / TWOPI);
         fmod(shared_angle, TWOPI);
 
-    if (helices.empty()) {
+    if (centers.empty()) {
       maggieDebug2("Creating helices");
       int rowstep = 30, colstep = 50, helixrowidx = 0;
       for (int row = 0; row < rows; row+=rowstep) {
         ++helixrowidx;
         for (int col = 0; col < cols; col+=colstep) {
           cv::Point center(col + (helixrowidx%2) * colstep/2, row);
-          helices.push_back(Helix(center, shared_angle_2pi, ANG_SPEED_IDLE));
+          centers.push_back(center);
+          angles.push_back(shared_angle_2pi);
+          angspeeds.push_back((float) ANG_SPEED_IDLE);
         } // end loop col
       } // end loop row
-    } // end if (helices.empty())
+      _last_refresh.reset();
+    } // end if (centers.empty())
+
+    // one clock for all helices
+    float dt_sec = _last_refresh.getTimeSeconds();
+    _last_refresh.reset();
 
     // user_image_to_rgb(user, img_out, 8);
     img_out.setTo(0);
-    draw_users_contour(user, 1, 255, img_out);
+    stats.compute(user);
+    draw_users_contour(user, 1, 255, img_out, &stats);
     // draw helices
-    for (unsigned int helix_idx = 0; helix_idx < helices.size(); ++helix_idx) {
-      helices[helix_idx].refresh_angle(user, shared_angle_2pi);
-      helices[helix_idx].draw_on(img_out);
+    for (unsigned int helix_idx = 0; helix_idx < centers.size(); ++helix_idx) {
+      refresh_angle(helix_idx, user, shared_angle_2pi, dt_sec);
+      draw_helix(helix_idx, img_out);
     }
   } // end fn();
 
   const char* name() const { return "Helices"; }
-  std::deque<Helix> helices;
+
+  //! the helices, as a structure of arrays
+  std::vector<cv::Point> centers;
+  std::vector<float> angles, angspeeds;
   Timer timer;
+  UserStats stats;
+
+private:
+  //////////////////////////////////////////////////////////////////////////////
+
+  void refresh_angle(const unsigned int helix_idx, const cv::Mat1b & user,
+                     const float & shared_angle_2pi, const float dt_sec) {
+    const cv::Point & center = centers[helix_idx];
+    float & angle = angles[helix_idx];
+    float & angspeed = angspeeds[helix_idx];
+    // update angle
+    angle += dt_sec * angspeed;
+
+    // change speed according to user mask
+    bool on_user = (center.x >= 0 && center.x < user.cols
+                    && center.y >= 0 && center.y < user.rows
+                    && user(center) != 0);
+    if (on_user) {
+      angspeed = std::min(ANG_SPEED_MAX, angspeed + ANG_SPEED_INCR);
+    }
+
+    // otherwise (slower than ANG_SPEED_IDLE), set to ANG_SPEED_IDLE
+    else if (angspeed <= ANG_SPEED_IDLE){
+      angle = shared_angle_2pi;
+      angspeed = ANG_SPEED_IDLE;
+    } // end if not user
+
+    // if slightly faster than ANG_SPEED_IDLE,
+    else if (angspeed <= ANG_SPEED_IDLE + 3 * ANG_SPEED_DECR) {
+      // keep this speed till being close to shared_angle
+      angspeed = ANG_SPEED_IDLE + 2 * ANG_SPEED_DECR; // slowdown speed
+      // close enough, ie angle ~= shared_angle + n PI
+      // <=> fmod( angle - shared_angle, PI ) ~= 0
+      // -> set angle to shared_angle
+      if (fmod(angle - shared_angle_2pi, M_PI) < .3) {
+        angle = shared_angle_2pi;
+        angspeed = ANG_SPEED_IDLE;
+      }
+    } // end if slightly faster than ANG_SPEED_IDLE
+
+    // if a lot faster, decrease speed
+    else /*if (angspeed > ANG_SPEED_IDLE + ANG_SPEED_DECR)*/ {
+      angspeed = std::max((float) 0, angspeed - ANG_SPEED_DECR);
+    }
+  } // end refresh_angle();
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! render the anti-aliased bar for each angle, and keep its non null pixels
+  void build_atlas() {
+    int size = 2 * (RADIUS + 2) + 1, mid = size / 2;
+    cv::Mat1b sprite(size, size);
+    _atlas_begin.resize(ATLAS_ANGLES + 1);
+    _atlas_pixels.clear();
+    static const int SHIFT = 4; // sub-pixel ends
+    for (int angle_idx = 0; angle_idx < ATLAS_ANGLES; ++angle_idx) {
+      _atlas_begin[angle_idx] = _atlas_pixels.size();
+      float angle = M_PI * angle_idx / ATLAS_ANGLES;
+      float cosa = cos(angle) * RADIUS * (1 << SHIFT),
+          sina = sin(angle) * RADIUS * (1 << SHIFT);
+      int midshift = mid << SHIFT;
+      sprite.setTo(0);
+      cv::line(sprite, cv::Point(midshift + cosa, midshift + sina),
+               cv::Point(midshift - cosa, midshift - sina),
+               cv::Scalar::all(255), 2, CV_AA, SHIFT);
+      for (int row = 0; row < size; ++row) {
+        for (int col = 0; col < size; ++col) {
+          if (sprite(row, col) == 0)
+            continue;
+          AtlasPixel pixel;
+          pixel.dx = col - mid;
+          pixel.dy = row - mid;
+          pixel.alpha = sprite(row, col);
+          _atlas_pixels.push_back(pixel);
+        } // end loop col
+      } // end loop row
+    } // end loop angle_idx
+    _atlas_begin[ATLAS_ANGLES] = _atlas_pixels.size();
+  } // end build_atlas();
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! blend the atlas bar of the helix angle onto \a img
+  void draw_helix(const unsigned int helix_idx, cv::Mat3b & img) const {
+    float angle_pi = fmod(angles[helix_idx], (float) M_PI);
+    if (angle_pi < 0)
+      angle_pi += M_PI;
+    int angle_idx = (int) (angle_pi * ATLAS_ANGLES / M_PI + .5) % ATLAS_ANGLES;
+    const cv::Point & center = centers[helix_idx];
+    for (int i = _atlas_begin[angle_idx]; i < _atlas_begin[angle_idx + 1]; ++i) {
+      const AtlasPixel & pixel = _atlas_pixels[i];
+      int col = center.x + pixel.dx, row = center.y + pixel.dy;
+      if (col < 0 || col >= img.cols || row < 0 || row >= img.rows)
+        continue;
+      uchar* out = img.ptr<uchar>(row) + 3 * col;
+      for (int chan = 0; chan < 3; ++chan)
+        out[chan] += ((_color[chan] - out[chan]) * pixel.alpha) / 255;
+    } // end loop i
+  } // end draw_helix();
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  Timer _last_refresh;
+  cv::Vec3b _color;
+  struct AtlasPixel {
+    short dx, dy;
+    uchar alpha;
+  };
+  //! the pixels of angle i are _atlas_pixels[_atlas_begin[i] .. _atlas_begin[i+1]-1]
+  std::vector<int> _atlas_begin;
+  std::vector<AtlasPixel> _atlas_pixels;
 }; // end class Helices
 
 #endif // HELICES_H
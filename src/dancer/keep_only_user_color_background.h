@@ -23,6 +23,7 @@ ________________________________________________________________________________
 \class KeepOnlyUserColorBackground
 \brief A \a EffectInterface that sets the background to a solid color,
 keeping color ony in the pixels indicated by user masks.
+The edges of the users are refined with an \a AlphaMatte.
 
  */
 
@@ -31,6 +32,7 @@ keeping color ony in the pixels indicated by user masks.
 
 #include "effect_interface.h"
 #include <opencv2/highgui/highgui.hpp>
+#include "alpha_matte.h"
 
 // make virtual inheritance to avoid "the diamond of death"
 // http://en.wikipedia.org/wiki/Diamond_problem#The_diamond_problem
@@ -45,7 +47,8 @@ public:
 
     img_out.create(user.size());
     img_out = _bg_color;
-    color.copyTo(img_out, user);
+    matte.compute(color, user, alpha);
+    image_utils::alpha_blend(color, alpha, img_out);
     //    for (int row = 0; row < color.rows; ++row) {
     //      // get the address of row
     //      const uchar* user_data = user.ptr<uchar>(row);
@@ -66,6 +69,8 @@ public:
   const char* name() const { return "KeepOnlyUserColorBackground"; }
 
   cv::Vec3b _bg_color;
+  AlphaMatte matte;
+  cv::Mat1b alpha;
 }; // end class KeepOnlyUserColorBackground
 
 
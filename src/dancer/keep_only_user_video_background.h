@@ -23,6 +23,12 @@ ________________________________________________________________________________
 \class KeepOnlyUserVideoBackground
 \brief A \a EffectInterface that sets a video file as background,
 keeping color ony in the pixels indicated by user masks.
+The edges of the users are refined with an \a AlphaMatte.
+
+The video plays at its own frame rate, whatever the rate of the effect:
+the frame shown is the one of the current playback time,
+repeated or skipped as needed.
+Optionally, the two frames around the playback time are blended.
 
 
  */
@@ -35,46 +41,105 @@ keeping color ony in the pixels indicated by user masks.
 #include <opencv2/imgproc/imgproc.hpp>
 
 #include "border_remover.h"
+#include "video_prefetcher.h"
+#include "video_frame_cache.h"
+#include "alpha_matte.h"
+#include "timer.h"
 
 // make virtual inheritance to avoid "the diamond of death"
 // http://en.wikipedia.org/wiki/Diamond_problem#The_diamond_problem
 class KeepOnlyUserVideoBackground : virtual public EffectInterface {
 public:
-  KeepOnlyUserVideoBackground(const std::string & video_filename) :
-    average_border_computed(false){
-    capture.open(video_filename);
-    if (!capture.isOpened())
-      maggiePrint("The video file '%s' was not opened succesfully!",
-             video_filename.c_str());
+  /*!
+   * \param use_frame_cache
+   *    if true, the video is decoded once into a raw frame file
+   *    (\a VideoFrameCache), used as soon as it is ready.
+   *    Only for short videos.
+   * \param blend_frames
+   *    if true, blend the two video frames around the playback time,
+   *    smoother when the effect runs faster than the video
+   */
+  KeepOnlyUserVideoBackground(const std::string & video_filename,
+                              bool use_frame_cache = false,
+                              bool blend_frames = false) :
+    _video_filename(video_filename), _video_ok(true),
+    _use_frame_cache(use_frame_cache), _blend_frames(blend_frames),
+    _playback_offset(0), _background_pts(0), average_border_computed(false) {
   }
 
   void fn(const cv::Mat3b & color, const cv::Mat1f & depth, const cv::Mat1b & user,
           const kinect::NiteSkeletonList & skeleton_list,
           cv::Mat3b & img_out) {
 
+    // (re)start decoding at the size of the color image
+    if (_video_ok && prefetcher.size() != color.size()) {
+      _video_ok = prefetcher.start(_video_filename, color.size());
+      if (_video_ok && _use_frame_cache)
+        frame_cache.start(_video_filename, color.size());
+      // the timestamps of the decoded frames start at 0
+      _playback_clock.reset();
+      _playback_offset = 0;
+    }
+
     // just set black background if no valid video
-    if (!capture.isOpened()) {
+    if (!_video_ok) {
+      img_out.create(color.size());
       img_out.setTo(0); // set background to black
       color.copyTo(img_out, user);
       return;
     }
 
-    // get the background video image
-    if (!capture.read(background)) { // end of video => rewind
-      maggieDebug2("Rewinding the background video");
-      capture.set(CV_CAP_PROP_POS_MSEC, 0);
-      if (!capture.read(background)) {
-        maggiePrint("Impossible to rewind the video!");
-        return;
+    // get the background video image of the playback time, already resized.
+    double playback_time = _playback_clock.getTimeSeconds() - _playback_offset;
+    if (_use_frame_cache && frame_cache.is_ready()) {
+      // no decoding needed anymore
+      if (prefetcher.is_running())
+        prefetcher.stop();
+      // same video: the prefetcher already checked its frame rate
+      double frame_pos = playback_time * prefetcher.fps();
+      int frame_idx = (int) frame_pos, nframes = frame_cache.nframes();
+      double next_weight = (_blend_frames ? frame_pos - frame_idx : 0);
+      if (next_weight > 0)
+        frame_cache.blend_frames(frame_idx % nframes, (frame_idx + 1) % nframes,
+                                 next_weight, img_out);
+      else
+        frame_cache.copy_frame(frame_idx % nframes, img_out);
+    }
+    else { // if the decoder is late, keep the previous one
+      prefetcher.pop_until(playback_time, background, _background_pts);
+      // more late than the ring can hold (effect inactive, slow decoder):
+      // re-anchor the playback on the current frame,
+      // otherwise the next calls would drain the ring at decoding speed
+      if (!background.empty() && playback_time - _background_pts
+          > prefetcher.ring_size() / prefetcher.fps()) {
+        maggieDebug2("KeepOnlyUserVideoBackground: %g s late, re-anchoring",
+                     playback_time - _background_pts);
+        _playback_offset += playback_time - _background_pts;
+        playback_time = _background_pts;
+      }
+      // the weight of _next_background, 0 if no blending
+      double next_weight = 0, next_pts;
+      if (_blend_frames && !background.empty()
+          && prefetcher.peek(_next_background, next_pts)
+          && next_pts > _background_pts)
+        next_weight = std::min(1., std::max(0., (playback_time - _background_pts)
+                                            / (next_pts - _background_pts)));
+      if (background.size() != color.size()) { // first frames not decoded yet
+        img_out.create(color.size());
+        img_out.setTo(0);
       }
+      else if (next_weight > 0 && _next_background.size() == color.size())
+        cv::addWeighted(background, 1 - next_weight,
+                        _next_background, next_weight, 0, img_out);
+      else
+        background.copyTo(img_out);
+      // do not keep the data of the ring of the prefetcher
+      _next_background.release();
     }
-    // copy the background to img_out
-    cv::resize(background, background_resized, color.size());
-    background_resized.copyTo(img_out);
 
-    // keep user from color image
-    cv::erode(user, user_mask, cv::Mat(5, 5, CV_8U, 255));
-    color.copyTo(img_out, user_mask);
+    // keep user from color image, with soft edges
+    matte.compute(color, user, alpha);
+    image_utils::alpha_blend(color, alpha, img_out);
 
     // paint a black frame where no depth info
     if (!average_border_computed) {
@@ -103,11 +168,25 @@ public:
 
   const char* name() const { return "KeepOnlyUserVideoBackground"; }
 
-  cv::VideoCapture capture;
-  cv::Mat3b background, background_resized;
+  std::string _video_filename;
+  bool _video_ok;
+  //! decodes and resizes the video in another thread
+  VideoPrefetcher prefetcher;
+  //! the decoded frames, if _use_frame_cache
+  bool _use_frame_cache;
+  VideoFrameCache frame_cache;
+  bool _blend_frames;
+  //! the time since the start of the video, in seconds
+  Timer _playback_clock;
+  //! the playback time is _playback_clock minus this, in seconds
+  double _playback_offset;
+  cv::Mat3b background, _next_background;
+  //! the timestamp of background, in seconds
+  double _background_pts;
   bool average_border_computed;
   image_utils::Coord left, right, up, down;
-  cv::Mat1b user_mask;
+  AlphaMatte matte;
+  cv::Mat1b alpha;
 }; // end class KeepOnlyUserVideoBackground
 
 #endif // KEEP_ONLY_USER_VIDEO_BACKGROUND_H
@@ -24,6 +24,18 @@ ________________________________________________________________________________
 \brief A \a EffectInterface that enables throwing small colorful particles
 thanks to the motion of the users.
 
+The particles are emitted either from the contour points
+that move fast (EMIT_FROM_CONTOURS),
+or from the hands and feet of the tracked skeletons (EMIT_FROM_JOINTS),
+whose filtered velocity is given by a \a JointKinematics:
+this is cheaper and steadier, but needs skeleton tracking.
+
+The particles are stored in a \a ParticlePool, whose budget bounds
+the number of particles, and thus the frame time.
+They are integrated and drawn on several threads by a \a ParticleRenderer.
+They can bounce and rest on the users, thanks to the \a DistanceField
+of the user mask, computed once per frame at a reduced resolution.
+
  */
 
 #ifndef PARTICLE_THROWER_H
@@ -32,12 +44,37 @@ thanks to the motion of the users.
 #include "compute_user_accelerations.h"
 #include "timer.h"
 #include "color_utils.h"
+#include "particle_pool.h"
+#include "particle_renderer.h"
+#include "joint_kinematics.h"
+#include "skeleton_utils.h"
 
 // make virtual inheritance to avoid "the diamond of death"
 // http://en.wikipedia.org/wiki/Diamond_problem#The_diamond_problem
 class ParticleThrower : virtual public ComputeUserAccelerations {
 public:
-  ParticleThrower() {
+  enum EmissionSource {
+    EMIT_FROM_CONTOURS = 0,
+    EMIT_FROM_JOINTS = 1
+  };
+  //! the min speed of a joint to emit particles, in pixels per second
+  static const int MIN_JOINT_SPEED = 300;
+  //! the particles farther than this on the sides of the image are killed
+  static const int SIDE_MARGIN = 50;
+  //! the reduction factor of the distance field of the users
+  static const int DISTANCE_FIELD_SCALE = 4;
+
+  /*!
+   * \param max_particles
+   *    the budget of particles: above, the oldest ones are evicted
+   * \param collide_with_users
+   *    true to make the particles bounce on the users
+   */
+  ParticleThrower(const EmissionSource emission_source = EMIT_FROM_CONTOURS,
+                  const unsigned int max_particles = 5000,
+                  const bool collide_with_users = true)
+    : particles(max_particles), _emission_source(emission_source),
+      _collide_with_users(collide_with_users) {
     // do not draw out iamge for ComputeUserAccelerations
     ComputeUserAccelerations::draw_img_flag = false;
   }
@@ -47,87 +84,126 @@ public:
   void fn(const cv::Mat3b & color, const cv::Mat1f & depth, const cv::Mat1b & user,
           const kinect::NiteSkeletonList & skeleton_list,
           cv::Mat3b & img_out) {
-    ComputeUserAccelerations::fn(color, depth, user, skeleton_list, img_out);
     // create new particles
-    for (unsigned int acc_idx = 0; acc_idx < accelerations.size(); ++acc_idx) {
-      Acceleration* curr_acc = &(accelerations[acc_idx]);
-      // if (drand48() > .9) {
-      if (curr_acc->norm / 25 > 1) {
-        Particle new_particle;
-        new_particle.mass = 15 + drand48() * 15;
-        new_particle.accel.y = new_particle.mass * Particle::G; // inversed y
-        new_particle.speed.x = 10 * curr_acc->norm * cos(curr_acc->orien);
-        new_particle.speed.y = 10 * curr_acc->norm * sin(curr_acc->orien);
-        new_particle.position = curr_acc->origin;
-        new_particle.color = color_utils::color<cv::Scalar>(-1);
-        particles.push_back(new_particle);
-      }
-    } // end loop acc_idx
-    maggieDebug2("accelerations: size:%i, particles: size %i",
-                      accelerations.size(), particles.size());
+    if (_emission_source == EMIT_FROM_JOINTS)
+      emit_from_joints(color.size(), skeleton_list);
+    else
+      emit_from_contours(color, depth, user, skeleton_list, img_out);
 
     // update all particles
     double dt_sec = last_time_update.getTimeSeconds();
-    for (unsigned int part_idx = 0; part_idx < particles.size(); ++part_idx) {
-      particles[part_idx].update(dt_sec);
-    } // end loop part_idx
+    renderer.integrate(particles, dt_sec);
     last_time_update.reset();
+    if (_collide_with_users) {
+      _user_field.build(user, DISTANCE_FIELD_SCALE);
+      particles.collide(_user_field, 3, .5, .2);
+    }
 
     // kill dead particles
-    for (unsigned int part_idx = 0; part_idx < particles.size(); ++part_idx) {
-      if (particles[part_idx].position.y > img_out.rows) {
-        particles.erase(particles.begin() + part_idx);
-        part_idx--;
-      }
-    } // end loop part_idx
+    particles.kill_out_of(-SIDE_MARGIN, color.cols + SIDE_MARGIN, color.rows);
 
     // draw
     img_out.create(color.size());
     img_out.setTo(0);
-    // draw simplified_contour -> put it in an empty vector
-    contours.clear();
-    contours.push_back(simplified_contour);
-    // cv::drawContours(img_out, contours, -1, CV_RGB(50, 0, 0), -1);
-    image_utils::drawListOfPoints(img_out, concatenated_contour, cv::Vec3b(255, 255, 255));
-
-    for (unsigned int part_idx = 0; part_idx < particles.size(); ++part_idx)
-      draw_particle(particles[part_idx], img_out);
+    if (_emission_source == EMIT_FROM_JOINTS)
+      skeleton_utils::draw_skeleton_list(img_out, skeleton_list, 2);
+    else {
+      // draw contours
+      // cv::drawContours(img_out, contours, -1, CV_RGB(50, 0, 0), -1);
+      for (unsigned int contour_idx = 0; contour_idx < contours.size(); ++contour_idx) {
+        if (contours[contour_idx].size() >= MIN_CONTOUR_SIZE)
+          image_utils::drawListOfPoints(img_out, contours[contour_idx], cv::Vec3b(255, 255, 255));
+      }
+    }
+
+    draw_particles(img_out);
   } // end fn();
 
   //////////////////////////////////////////////////////////////////////////////
 
 protected:
-  Timer last_time_update;
+  //////////////////////////////////////////////////////////////////////////////
 
-  struct Particle {
-    static const double G = 9.81;
-    void update(double dt_sec) {
-      speed.x += dt_sec * accel.x;
-      speed.y += dt_sec * accel.y;
-      position.x += dt_sec * speed.x;
-      position.y += dt_sec * speed.y;
-    }
-    double mass;
-    cv::Point2f position, speed, accel;
-    cv::Scalar color;
-  };
-  std::vector<Particle> particles;
+  //! emit from the contour points with a high acceleration
+  void emit_from_contours(const cv::Mat3b & color, const cv::Mat1f & depth,
+                          const cv::Mat1b & user,
+                          const kinect::NiteSkeletonList & skeleton_list,
+                          cv::Mat3b & img_out) {
+    ComputeUserAccelerations::fn(color, depth, user, skeleton_list, img_out);
+    for (unsigned int acc_idx = 0; acc_idx < accelerations.size(); ++acc_idx) {
+      Acceleration* curr_acc = &(accelerations[acc_idx]);
+      // if (drand48() > .9) {
+      if (curr_acc->norm / 25 > 1) {
+        add_particle(curr_acc->origin,
+                     cv::Point2f(10 * curr_acc->norm * cos(curr_acc->orien),
+                                 10 * curr_acc->norm * sin(curr_acc->orien)));
+      }
+    } // end loop acc_idx
+    maggieDebug2("accelerations: size:%i, particles: size %i",
+                      (int) accelerations.size(), (int) particles.size());
+  } // end emit_from_contours();
 
   //////////////////////////////////////////////////////////////////////////////
 
-  virtual void draw_particle(const Particle & p, cv::Mat3b & img_out) {
-    // body
-    cv::circle(img_out, cv::Point(p.position.x, p.position.y),
-               2 + p.mass / 10, p.color, -1);
-    // tail
-    //    cv::line(img_out, cv::Point(p.position.x, p.position.y),
-    //             cv::Point(p.position.x + p.speed.x, p.position.y + p.speed.y),
-    //             CV_RGB(200, 0, 0), 1);
+  //! emit from the hands and feet that move fast, with their velocity
+  void emit_from_joints(const cv::Size & img_size,
+                        const kinect::NiteSkeletonList & skeleton_list) {
+    static const int EMITTERS[4] = {
+      kinect::NiteSkeletonJoint::SKEL_LEFT_HAND, kinect::NiteSkeletonJoint::SKEL_RIGHT_HAND,
+      kinect::NiteSkeletonJoint::SKEL_LEFT_FOOT, kinect::NiteSkeletonJoint::SKEL_RIGHT_FOOT
+    };
+    // at the stamp of the skeletons: dt is the real interval between two frames
+    _joint_kinematics.update(skeleton_list);
+    _joint_kinematics.user_ids(_user_ids);
+    for (unsigned int user_idx = 0; user_idx < _user_ids.size(); ++user_idx) {
+      for (unsigned int emitter_idx = 0; emitter_idx < 4; ++emitter_idx) {
+        const JointKinematics::JointState* state =
+            _joint_kinematics.get(_user_ids[user_idx], EMITTERS[emitter_idx]);
+        if (state == NULL || !state->tracked)
+          continue;
+        cv::Point2f speed(state->image_velocity.x * img_size.width,
+                          state->image_velocity.y * img_size.height);
+        if (speed.x * speed.x + speed.y * speed.y < MIN_JOINT_SPEED * MIN_JOINT_SPEED)
+          continue;
+        add_particle(cv::Point2f(state->image_position.x * img_size.width,
+                                 state->image_position.y * img_size.height),
+                     speed);
+      } // end loop emitter_idx
+    } // end loop user_idx
+    maggieDebug2("users: size:%i, particles: size %i",
+                 (int) _user_ids.size(), (int) particles.size());
+  } // end emit_from_joints();
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  inline void add_particle(const cv::Point2f & position, const cv::Point2f & speed) {
+    particles.add(position, speed, 15 + drand48() * 15,
+                  color_utils::color<cv::Vec3b>(-1));
   }
 
   //////////////////////////////////////////////////////////////////////////////
 
-  const char* name() const { return "ParticleThrower"; }
+  Timer last_time_update;
+  ParticlePool particles;
+  ParticleRenderer renderer;
+  EmissionSource _emission_source;
+  bool _collide_with_users;
+  DistanceField _user_field;
+  JointKinematics _joint_kinematics;
+  std::vector<int> _user_ids;
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  virtual void draw_particles(cv::Mat3b & img_out) {
+    renderer.render(particles, img_out);
+  } // end draw_particles();
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  const char* name() const {
+    return (_emission_source == EMIT_FROM_JOINTS ? "ParticleThrower (joints)"
+                                                 : "ParticleThrower");
+  }
 }; // end class ParticleThrower
 
 #endif // PARTICLE_THROWER_H
@@ -23,12 +23,19 @@ ________________________________________________________________________________
 \class RemoveUserInPaint
 \brief A \a EffectInterface that removes the user by inpaint it.
 
+The background seen when the user moves is kept in a \a CleanPlate,
+and copied where the user is.
+Only the pixels never seen are inpainted, in their bounding box.
+Left click to forget the background.
+
  */
 
 #ifndef REMOVE_USER_INPAINT_H
 #define REMOVE_USER_INPAINT_H
 
 #include "effect_interface.h"
+#include "morph_utils.h"
+#include "clean_plate.h"
 
 #include <opencv2/core/version.hpp>
 #if (CV_MAJOR_VERSION > 2) || (CV_MAJOR_VERSION == 2 && CV_MINOR_VERSION > 3)
@@ -36,27 +43,47 @@ ________________________________________________________________________________
 #endif
 
 #define DILATE_KERNEL_SIZE 10
+#define INPAINT_RADIUS 5
 
 // make virtual inheritance to avoid "the diamond of death"
 // http://en.wikipedia.org/wiki/Diamond_problem#The_diamond_problem
 class RemoveUserInPaint : virtual public EffectInterface{
 public:
-  RemoveUserInPaint() {
-    dilate_kernel = cv::Mat(DILATE_KERNEL_SIZE, DILATE_KERNEL_SIZE, CV_8U, 255);
-  }
-
   void fn(const cv::Mat3b & color, const cv::Mat1f & depth, const cv::Mat1b & user,
           const kinect::NiteSkeletonList & skeleton_list,
           cv::Mat3b & img_out) {
-    color.copyTo(img_out);
     cv::threshold(user, mask, 0, 255, CV_THRESH_BINARY);
-    cv::dilate(mask, mask, dilate_kernel);
-    cv::inpaint(img_out, mask, img_out, 5, cv::INPAINT_NS);
+    morph.dilate_rect(mask, mask, DILATE_KERNEL_SIZE, DILATE_KERNEL_SIZE);
+    cv::Rect bbox = clean_plate.apply(color, mask, img_out, unobserved);
+    if (bbox.width == 0)
+      return;
+    // the inpainting needs the neighbours of the unobserved pixels
+    cv::Rect roi(bbox.x - INPAINT_RADIUS, bbox.y - INPAINT_RADIUS,
+                 bbox.width + 2 * INPAINT_RADIUS, bbox.height + 2 * INPAINT_RADIUS);
+    roi &= cv::Rect(0, 0, color.cols, color.rows);
+    cv::Mat3b img_out_roi = img_out(roi);
+    cv::inpaint(img_out_roi, unobserved(roi), img_out_roi,
+                INPAINT_RADIUS, cv::INPAINT_NS);
   } // end fn();
 
+  //////////////////////////////////////////////////////////////////////////////
+
+  void first_call() {
+    maggiePrint("Left click to forget the background");
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! custom mouse callback
+  virtual void mouse_cb(int event, int x, int y) {
+    if (event == CV_EVENT_LBUTTONDOWN)
+      clean_plate.reset();
+  } // end mouse_cb();
+
   const char* name() const { return "RemoveUserInPaint"; }
-  cv::Mat dilate_kernel;
-  cv::Mat1b mask;
+  image_utils::MaskMorphology morph;
+  CleanPlate clean_plate;
+  cv::Mat1b mask, unobserved;
 }; // end class RemoveUserInPaint
 
 #endif // REMOVE_USER_INPAINT_H
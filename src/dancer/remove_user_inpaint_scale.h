@@ -23,6 +23,8 @@ ________________________________________________________________________________
 \class RemoveUserInPaintScale
 \brief A \a EffectInterface that removes the user by inpaint it.
 It is faster by scaling the picture down.
+Only the bounding box of the dilated users, plus the inpaint radius,
+is scaled and inpainted: the rest of the frame is a straight copy.
 
  */
 
@@ -30,37 +32,65 @@ It is faster by scaling the picture down.
 #define REMOVE_USER_INPAINT_SCALE_H
 
 #include "effect_interface.h"
+#include "morph_utils.h"
+
+#ifndef DILATE_KERNEL_SIZE
+#define DILATE_KERNEL_SIZE 10
+#endif
+#ifndef INPAINT_RADIUS
+#define INPAINT_RADIUS 5
+#endif
 
 // make virtual inheritance to avoid "the diamond of death"
 // http://en.wikipedia.org/wiki/Diamond_problem#The_diamond_problem
 class RemoveUserInPaintScale : virtual public EffectInterface{
 public:
-  RemoveUserInPaintScale() {
+  /*!
+   * \param interp
+   *    how the inpainted patch is scaled back up,
+   *    CV_INTER_LINEAR or CV_INTER_NN (faster, blocky)
+   */
+  RemoveUserInPaintScale(const int interp = CV_INTER_LINEAR)
+    : interpolation(interp) {
     scale = .3f;
-    dilate_kernel = cv::Mat(DILATE_KERNEL_SIZE, DILATE_KERNEL_SIZE, CV_8U, 255);
   }
 
   void fn(const cv::Mat3b & color, const cv::Mat1f & depth, const cv::Mat1b & user,
           const kinect::NiteSkeletonList & skeleton_list,
           cv::Mat3b & img_out) {
 
-    cv::resize(color, img_out_scaled, cv::Size(), scale, scale, CV_INTER_NN);
-    cv::dilate((user != 0), mask, dilate_kernel);
+    color.copyTo(img_out);
+    cv::threshold(user, mask, 0, 255, CV_THRESH_BINARY);
+    morph.dilate_rect(mask, mask, DILATE_KERNEL_SIZE, DILATE_KERNEL_SIZE);
     //cv::imshow("mask", mask); cv::waitKey(10);
-    cv::resize(mask, mask_scaled, cv::Size(), scale, scale, CV_INTER_NN);
+    cv::Rect bbox = image_utils::nonzero_bbox(mask);
+    if (bbox.width == 0)
+      return;
+    // the inpainting needs INPAINT_RADIUS pixels around the mask, at low res
+    int margin = (int) std::ceil(INPAINT_RADIUS / scale);
+    cv::Rect roi(bbox.x - margin, bbox.y - margin,
+                 bbox.width + 2 * margin, bbox.height + 2 * margin);
+    roi &= cv::Rect(0, 0, color.cols, color.rows);
+    cv::Size scaled_size(std::max(1, (int) (roi.width * scale)),
+                         std::max(1, (int) (roi.height * scale)));
+
+    cv::resize(color(roi), img_out_scaled, scaled_size, 0, 0, CV_INTER_NN);
+    cv::resize(mask(roi), mask_scaled, scaled_size, 0, 0, CV_INTER_NN);
     // cv::inpaint(img_out_scaled, mask_scaled, img_out_scaled, 5, cv::INPAINT_NS);
-    cv::inpaint(img_out_scaled, mask_scaled, img_out_scaled, 5, cv::INPAINT_TELEA);
-    cv::resize(img_out_scaled, img_out, cv::Size(), 1.f / scale, 1.f / scale,
-               CV_INTER_NN);
-    // restores the hi res outside of the mask
-    color.copyTo(img_out, mask == 0);
+    cv::inpaint(img_out_scaled, mask_scaled, img_out_scaled,
+                INPAINT_RADIUS, cv::INPAINT_TELEA);
+    cv::resize(img_out_scaled, patch, roi.size(), 0, 0, interpolation);
+    // keep the hi res outside of the mask
+    cv::Mat3b img_out_roi = img_out(roi);
+    patch.copyTo(img_out_roi, mask(roi));
   } // end fn();
 
   const char* name() const { return "RemoveUserInPaintScale"; }
-  cv::Mat dilate_kernel;
+  image_utils::MaskMorphology morph;
   cv::Mat1b mask, mask_scaled;
-  cv::Mat3b img_out_scaled;
+  cv::Mat3b img_out_scaled, patch;
   double scale;
+  int interpolation;
 }; // end class RemoveUserInPaintScale
 
 #endif // REMOVE_USER_INPAINT_SCALE_H
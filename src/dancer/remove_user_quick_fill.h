@@ -21,7 +21,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ________________________________________________________________________________
 
 \class RemoveUserQuickFill
-\brief A \a EffectInterface that removes the user by propagating the values on his left.
+\brief A \a EffectInterface that removes the user by interpolating
+the pixels around him, horizontally and vertically (\a image_utils::MaskFiller).
 
  */
 
@@ -30,7 +31,7 @@ ________________________________________________________________________________
 
 #include "effect_interface.h"
 #include "value_remover.h"
-#include "set_user_to_black.h"
+#include "morph_utils.h"
 
 #define DILATE_KERNEL_SIZE 10
 
@@ -38,21 +39,18 @@ ________________________________________________________________________________
 // http://en.wikipedia.org/wiki/Diamond_problem#The_diamond_problem
 class RemoveUserQuickFill : virtual public EffectInterface {
 public:
-  RemoveUserQuickFill() {
-    dilate_kernel = cv::Mat(DILATE_KERNEL_SIZE, DILATE_KERNEL_SIZE, CV_8U, 255);
-  }
-
   void fn(const cv::Mat3b & color, const cv::Mat1f & depth, const cv::Mat1b & user,
           const kinect::NiteSkeletonList & skeleton_list,
           cv::Mat3b & img_out) {
     color.copyTo(img_out);
-    set_user_pixels_to_color_in_out(user, img_out, dilate_kernel, mask,
-                                    CV_RGB(0, 0, 0));
-    image_utils::remove_value_left_propagation(img_out, cv::Vec3b(0,0,0));
+    cv::threshold(user, mask, 0, 255, CV_THRESH_BINARY);
+    morph.dilate_rect(mask, mask, DILATE_KERNEL_SIZE, DILATE_KERNEL_SIZE);
+    filler.fill(img_out, mask);
   } // end fn();
 
   const char* name() const { return "RemoveUserQuickFill"; }
-  cv::Mat dilate_kernel;
+  image_utils::MaskMorphology morph;
+  image_utils::MaskFiller filler;
   cv::Mat1b mask;
 }; // end class RemoveUserQuickFill
 
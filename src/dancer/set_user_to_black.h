@@ -29,13 +29,15 @@ ________________________________________________________________________________
 #define SET_USER_TO_BLACK_H
 
 #include "effect_interface.h"
+#include "morph_utils.h"
 
 #define DILATE_KERNEL_SIZE 10
 
 //! set all pixels that are not null in user to black in img_out
 inline void set_user_pixels_to_color_in_out(const cv::Mat1b & user,
                                             cv::Mat3b & img_out,
-                                            const cv::Mat & dilate_kernel,
+                                            image_utils::MaskMorphology & morph,
+                                            const int dilate_kernel_size,
                                             cv::Mat1b &mask,
                                             const cv::Scalar& color_out) {
   // first, modify mask so as to
@@ -43,7 +45,7 @@ inline void set_user_pixels_to_color_in_out(const cv::Mat1b & user,
   cv::threshold(user, mask, 0, 255, CV_THRESH_BINARY);
 
   // make the white bigger
-  cv::dilate(mask, mask, dilate_kernel);
+  morph.dilate_rect(mask, mask, dilate_kernel_size, dilate_kernel_size);
   // cv::imshow("mask", mask);
 
 #if 0
@@ -71,20 +73,16 @@ inline void set_user_pixels_to_color_in_out(const cv::Mat1b & user,
 // http://en.wikipedia.org/wiki/Diamond_problem#The_diamond_problem
 class SetUserToBlack : virtual public EffectInterface{
 public:
-  SetUserToBlack() {
-    dilate_kernel = cv::Mat(DILATE_KERNEL_SIZE, DILATE_KERNEL_SIZE, CV_8U, 255);
-  }
-
   void fn(const cv::Mat3b & color, const cv::Mat1f & depth, const cv::Mat1b & user,
           const kinect::NiteSkeletonList & skeleton_list,
           cv::Mat3b & img_out) {
     color.copyTo(img_out);
-    set_user_pixels_to_color_in_out(user, img_out, dilate_kernel, mask,
+    set_user_pixels_to_color_in_out(user, img_out, morph, DILATE_KERNEL_SIZE, mask,
                                     CV_RGB(255, 0, 0));
   } // end fn();
 
   const char* name() const { return "SetUserToBlack"; }
-  cv::Mat dilate_kernel;
+  image_utils::MaskMorphology morph;
   cv::Mat1b mask;
 }; // end class SetUserToBlack
 
@@ -0,0 +1,176 @@
+/*!
+  \file        depth_hole_filler.h
+  \author      Arnaud Ramey <arnaud.a.ramey@gmail.com>
+                -- Robotics Lab, University Carlos III of Madrid
+  \date        2013/10/20
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+
+\class DepthHoleFiller
+\brief Fills the holes (NAN_DEPTH) of a depth image with a push-pull pyramid.
+
+Push: each level of the pyramid is the max of the 2x2 pixels of the level
+below. As holes are 0, they are ignored by the max.
+Pull: from the coarsest level to the finest, each hole takes the value
+of its parent.
+
+There is no interpolation, so the edges are not blurred,
+and the fill is biased towards the background:
+the holes of the Kinect are mostly the shadows of the silhouettes,
+that belong to the background.
+
+Optionally, a hole can first take the last valid value of the pixel,
+if it was seen recently.
+
+Template _T: float for depth in meters, unsigned short for depth in mm.
+
+ */
+
+#ifndef DEPTH_HOLE_FILLER_H
+#define DEPTH_HOLE_FILLER_H
+
+#include <opencv2/core/core.hpp>
+#include <vector>
+#include "nan_handling.h"
+
+template<class _T>
+class DepthHoleFiller {
+public:
+  /*!
+   * \param max_temporal_age
+   *    the number of frames a hole can take the last valid value of the pixel.
+   *    0 to disable the temporal fill.
+   */
+  DepthHoleFiller(const int max_temporal_age = 0)
+    : _max_temporal_age(max_temporal_age) {}
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * \param in
+   *    the depth image, with holes
+   * \param out
+   *    the filled depth image. Can be the same as \a in.
+   *    Only an image without any valid pixel keeps its holes.
+   */
+  void fill(const cv::Mat_<_T> & in, cv::Mat_<_T> & out) {
+    if (_levels.empty())
+      _levels.resize(1);
+    cv::Mat_<_T> & level0 = _levels[0];
+    level0.create(in.size());
+    bool use_temporal = (_max_temporal_age > 0);
+    if (use_temporal && _last_valid.size() != in.size()) {
+      _last_valid.create(in.size());
+      _last_valid.setTo(0);
+      _age.create(in.size());
+      _age.setTo(255);
+    }
+
+    // copy the input, cleaning NaNs and applying the temporal fill
+    int nholes = 0;
+    for (int row = 0; row < in.rows; ++row) {
+      const _T* in_data = in[row];
+      _T* out_data = level0[row];
+      _T* last_data = (use_temporal ? _last_valid[row] : NULL);
+      uchar* age_data = (use_temporal ? _age[row] : NULL);
+      for (int col = 0; col < in.cols; ++col) {
+        _T v = in_data[col];
+        if (!image_utils::is_nan_depth(v)) {
+          out_data[col] = v;
+          if (use_temporal) {
+            last_data[col] = v;
+            age_data[col] = 0;
+          }
+          continue;
+        }
+        if (use_temporal && age_data[col] < _max_temporal_age) {
+          out_data[col] = last_data[col];
+          ++age_data[col];
+          continue;
+        }
+        if (use_temporal && age_data[col] < 255)
+          ++age_data[col];
+        out_data[col] = 0;
+        ++nholes;
+      } // end loop col
+    } // end loop row
+
+    // push: max pyramid, until there is no hole or a single pixel
+    unsigned int nlevels = 1;
+    while (nholes > 0
+           && (_levels[nlevels - 1].cols > 1 || _levels[nlevels - 1].rows > 1)) {
+      if (_levels.size() <= nlevels)
+        _levels.resize(nlevels + 1);
+      nholes = push(_levels[nlevels - 1], _levels[nlevels]);
+      ++nlevels;
+    }
+
+    // pull: holes take the value of their parent
+    for (int level = nlevels - 2; level >= 0; --level)
+      pull(_levels[level + 1], _levels[level]);
+
+    // _levels may have been reallocated
+    _levels[0].copyTo(out);
+  } // end fill();
+
+private:
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! \return the number of holes in \a coarse
+  static int push(const cv::Mat_<_T> & fine, cv::Mat_<_T> & coarse) {
+    coarse.create((fine.rows + 1) / 2, (fine.cols + 1) / 2);
+    int nholes = 0;
+    for (int row = 0; row < coarse.rows; ++row) {
+      const _T* fine_data1 = fine[2 * row];
+      const _T* fine_data2 = fine[std::min(2 * row + 1, fine.rows - 1)];
+      _T* coarse_data = coarse[row];
+      for (int col = 0; col < coarse.cols; ++col) {
+        int col1 = 2 * col, col2 = std::min(2 * col + 1, fine.cols - 1);
+        _T v = std::max(std::max(fine_data1[col1], fine_data1[col2]),
+                        std::max(fine_data2[col1], fine_data2[col2]));
+        coarse_data[col] = v;
+        if (v == 0)
+          ++nholes;
+      } // end loop col
+    } // end loop row
+    return nholes;
+  } // end push();
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  static void pull(const cv::Mat_<_T> & coarse, cv::Mat_<_T> & fine) {
+    for (int row = 0; row < fine.rows; ++row) {
+      const _T* coarse_data = coarse[row / 2];
+      _T* fine_data = fine[row];
+      for (int col = 0; col < fine.cols; ++col) {
+        if (fine_data[col] == 0)
+          fine_data[col] = coarse_data[col / 2];
+      } // end loop col
+    } // end loop row
+  } // end pull();
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  int _max_temporal_age;
+  //! the pyramid, level 0 is the full resolution
+  std::vector<cv::Mat_<_T> > _levels;
+  //! the last valid value of each pixel and its age in frames
+  cv::Mat_<_T> _last_valid;
+  cv::Mat1b _age;
+}; // end class DepthHoleFiller
+
+#endif // DEPTH_HOLE_FILLER_H
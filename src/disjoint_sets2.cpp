@@ -5,6 +5,7 @@
 #include <iostream>
 #include <iomanip>
 #include <map>
+#include <algorithm>
 
 //! uncomment to print info on times needed
 //#define TIMER_ON
@@ -14,10 +15,15 @@
 Timer timer;
 #endif // TIMER_ON
 
+#if (CV_MAJOR_VERSION > 2) || (CV_MAJOR_VERSION == 2 && CV_MINOR_VERSION > 3)
+#define DISJOINT_SETS2_PARALLEL
+#endif
+
 ////////////////////////////////////////////////////////////////////////////////
 
 DisjointSets2::DisjointSets2(const DisjointSets2::CompIndex & new_count /* = 0 */) {
   maggieDebug3("DisjointSets2 ctor");
+  _runs_cols = _runs_rows = 0;
   roots = NULL;
   ranks = NULL;
   sizes = NULL;
@@ -30,6 +36,7 @@ DisjointSets2::DisjointSets2(const DisjointSets2::CompIndex & new_count /* = 0 *
 
 DisjointSets2::DisjointSets2(cv::Mat1b & img){
   maggieDebug3("DisjointSets2 ctor");
+  _runs_cols = _runs_rows = 0;
   roots = NULL;
   ranks = NULL;
   sizes = NULL;
@@ -491,3 +498,272 @@ cv::Point DisjointSets2::centroidOfMonochromeImage(const int cols) {
 }
 
 ////////////////////////////////////////////////////////////////////////////////
+
+void DisjointSets2::label_band(const cv::Mat1b & img, int row_begin, int row_end,
+                               RunList & band_runs,
+                               std::vector<CompIndex> & band_parents) {
+  band_runs.clear();
+  band_parents.clear();
+  CompIndex prev_begin = 0, prev_end = 0;
+  for (int row = row_begin; row < row_end; ++row) {
+    const uchar* data = img.ptr<uchar>(row);
+    CompIndex curr_begin = band_runs.size();
+    // extract the runs of the row
+    int col = 0;
+    while (col < img.cols) {
+      while (col < img.cols && data[col] == 0)
+        ++col;
+      if (col == img.cols)
+        break;
+      Run run;
+      run.row = row;
+      run.start_col = col;
+      while (col < img.cols && data[col] != 0)
+        ++col;
+      run.end_col = col;
+      run.label = NO_NODE;
+      band_parents.push_back(band_runs.size());
+      band_runs.push_back(run);
+    } // end while (col < img.cols)
+    CompIndex curr_end = band_runs.size();
+    // union with the runs of the row above
+    union_overlapping_runs(band_runs, band_parents,
+                           prev_begin, prev_end, curr_begin, curr_end);
+    prev_begin = curr_begin;
+    prev_end = curr_end;
+  } // end loop row
+} // end label_band();
+
+////////////////////////////////////////////////////////////////////////////////
+
+void DisjointSets2::union_overlapping_runs(const RunList & runs_vec,
+                                           std::vector<CompIndex> & parents,
+                                           CompIndex prev_begin, CompIndex prev_end,
+                                           CompIndex curr_begin, CompIndex curr_end) {
+  // both rows are sorted by column => linear merge
+  CompIndex prev_idx = prev_begin, curr_idx = curr_begin;
+  while (prev_idx < prev_end && curr_idx < curr_end) {
+    const Run & prev = runs_vec[prev_idx], & curr = runs_vec[curr_idx];
+    // 4-connexity: the runs must share at least one column
+    if (prev.start_col < curr.end_col && curr.start_col < prev.end_col)
+      union_runs(parents, prev_idx, curr_idx);
+    // advance the run that finishes first
+    if (prev.end_col < curr.end_col)
+      ++prev_idx;
+    else
+      ++curr_idx;
+  } // end while
+} // end union_overlapping_runs();
+
+////////////////////////////////////////////////////////////////////////////////
+
+#ifdef DISJOINT_SETS2_PARALLEL
+//! labels each band of the image in a separate thread
+class RunBandLabeller : public cv::ParallelLoopBody {
+public:
+  typedef void (*LabelFn)(const cv::Mat1b &, int, int,
+                          DisjointSets2::RunList &,
+                          std::vector<DisjointSets2::CompIndex> &);
+  RunBandLabeller(const cv::Mat1b & img, int band_height, LabelFn fn,
+                  std::vector<DisjointSets2::RunList> & band_runs,
+                  std::vector< std::vector<DisjointSets2::CompIndex> > & band_parents)
+    : _img(img), _band_height(band_height), _fn(fn),
+      _band_runs(band_runs), _band_parents(band_parents) {}
+
+  void operator()(const cv::Range & range) const {
+    for (int band_idx = range.start; band_idx < range.end; ++band_idx) {
+      int row_begin = band_idx * _band_height;
+      int row_end = std::min(_img.rows, row_begin + _band_height);
+      _fn(_img, row_begin, row_end, _band_runs[band_idx], _band_parents[band_idx]);
+    }
+  }
+
+private:
+  const cv::Mat1b & _img;
+  int _band_height;
+  LabelFn _fn;
+  std::vector<DisjointSets2::RunList> & _band_runs;
+  std::vector< std::vector<DisjointSets2::CompIndex> > & _band_parents;
+}; // end class RunBandLabeller
+#endif // DISJOINT_SETS2_PARALLEL
+
+////////////////////////////////////////////////////////////////////////////////
+
+void DisjointSets2::process_image_runs(const cv::Mat1b & img,
+                                       int nb_blocks /*= 1*/) {
+  maggieDebug3("process_image_runs()");
+
+#ifdef TIMER_ON
+  timer.reset();
+#endif // TIMER_ON
+
+  _runs.clear();
+  _run_parents.clear();
+  _run_comp_sizes.clear();
+  _runs_cols = img.cols;
+  _runs_rows = img.rows;
+  nb_comp = 0;
+  biggest_comp_idx = 0;
+  biggest_comp_size = 0;
+  if (img.empty())
+    return;
+
+  // first pass: label each band independently
+  nb_blocks = std::max(1, std::min(nb_blocks, img.rows));
+  int band_height = (img.rows + nb_blocks - 1) / nb_blocks;
+  nb_blocks = (img.rows + band_height - 1) / band_height;
+  _band_runs.resize(nb_blocks);
+  _band_parents.resize(nb_blocks);
+#ifdef DISJOINT_SETS2_PARALLEL
+  if (nb_blocks > 1)
+    cv::parallel_for_(cv::Range(0, nb_blocks),
+                      RunBandLabeller(img, band_height, &DisjointSets2::label_band,
+                                      _band_runs, _band_parents));
+  else
+#endif // DISJOINT_SETS2_PARALLEL
+    for (int band_idx = 0; band_idx < nb_blocks; ++band_idx)
+      label_band(img, band_idx * band_height,
+                 std::min(img.rows, (band_idx + 1) * band_height),
+                 _band_runs[band_idx], _band_parents[band_idx]);
+
+  // concatenate the bands, shifting their local equivalence tables
+  size_t nruns = 0;
+  for (int band_idx = 0; band_idx < nb_blocks; ++band_idx)
+    nruns += _band_runs[band_idx].size();
+  _runs.reserve(nruns);
+  _run_parents.reserve(nruns);
+  // the runs of the last row of the previous band
+  CompIndex prev_begin = 0, prev_end = 0;
+  for (int band_idx = 0; band_idx < nb_blocks; ++band_idx) {
+    const RunList & band_runs = _band_runs[band_idx];
+    const std::vector<CompIndex> & band_parents = _band_parents[band_idx];
+    CompIndex offset = _runs.size();
+    _runs.insert(_runs.end(), band_runs.begin(), band_runs.end());
+    for (unsigned int run_idx = 0; run_idx < band_parents.size(); ++run_idx)
+      _run_parents.push_back(offset + band_parents[run_idx]);
+    if (band_runs.empty())
+      continue;
+
+    // border merge: first row of this band with the last row of the previous one
+    int first_row = band_idx * band_height;
+    CompIndex curr_begin = offset, curr_end = offset;
+    while (curr_end < (CompIndex) _runs.size() && _runs[curr_end].row == first_row)
+      ++curr_end;
+    if (prev_end > prev_begin && _runs[prev_begin].row == first_row - 1)
+      union_overlapping_runs(_runs, _run_parents,
+                             prev_begin, prev_end, curr_begin, curr_end);
+
+    // find the runs of the last row of this band
+    int last_row = _runs.back().row;
+    prev_end = _runs.size();
+    prev_begin = prev_end;
+    while (prev_begin > offset && _runs[prev_begin - 1].row == last_row)
+      --prev_begin;
+  } // end loop band_idx
+
+  // second pass: flatten the equivalence table into consecutive labels.
+  // Roots always have the smallest index of their set => one forward pass.
+  for (unsigned int run_idx = 0; run_idx < _runs.size(); ++run_idx) {
+    Run & run = _runs[run_idx];
+    CompIndex root = _run_parents[run_idx];
+    if (root == (CompIndex) run_idx) {
+      run.label = nb_comp++;
+      _run_comp_sizes.push_back(0);
+    }
+    else
+      run.label = _runs[find_run_root(_run_parents, root)].label;
+    CompSize & size = _run_comp_sizes[run.label];
+    size += run.end_col - run.start_col;
+    if (size > biggest_comp_size) {
+      biggest_comp_size = size;
+      biggest_comp_idx = run.label;
+    }
+  } // end loop run_idx
+
+#ifdef TIMER_ON
+  timer.printTime("process_image_runs()");
+#endif // TIMER_ON
+} // end process_image_runs();
+
+////////////////////////////////////////////////////////////////////////////////
+
+void DisjointSets2::get_connected_components_runs
+(std::vector<RunList> & components_runs,
+ std::vector<cv::Rect> & boundingBoxes) const {
+  components_runs.clear();
+  components_runs.resize(nb_comp);
+  boundingBoxes.clear();
+  boundingBoxes.resize(nb_comp);
+  for (CompIndex comp_idx = 0; comp_idx < nb_comp; ++comp_idx)
+    boundingBoxes[comp_idx].width = -1; // not initialized
+  for (unsigned int run_idx = 0; run_idx < _runs.size(); ++run_idx) {
+    const Run & run = _runs[run_idx];
+    components_runs[run.label].push_back(run);
+    cv::Rect & bbox = boundingBoxes[run.label];
+    if (bbox.width < 0) {
+      bbox = cv::Rect(run.start_col, run.row, run.end_col - run.start_col, 1);
+      continue;
+    }
+    // runs are sorted by row => only the bottom can grow
+    int right = std::max(bbox.x + bbox.width, run.end_col);
+    bbox.x = std::min(bbox.x, run.start_col);
+    bbox.width = right - bbox.x;
+    bbox.height = run.row + 1 - bbox.y;
+  } // end loop run_idx
+} // end get_connected_components_runs();
+
+////////////////////////////////////////////////////////////////////////////////
+
+void DisjointSets2::get_labels(cv::Mat1i & labels) const {
+  labels.create(_runs_rows, _runs_cols);
+  labels.setTo(0);
+  for (unsigned int run_idx = 0; run_idx < _runs.size(); ++run_idx) {
+    const Run & run = _runs[run_idx];
+    int* data = labels.ptr<int>(run.row);
+    std::fill(data + run.start_col, data + run.end_col, run.label + 1);
+  } // end loop run_idx
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+//! sort components by decreasing size
+struct BiggerComp {
+  BiggerComp(const std::vector<DisjointSets2::CompSize> & sizes) : _sizes(sizes) {}
+  inline bool operator()(DisjointSets2::CompIndex a, DisjointSets2::CompIndex b) const {
+    return _sizes[a] > _sizes[b];
+  }
+  const std::vector<DisjointSets2::CompSize> & _sizes;
+};
+
+void DisjointSets2::get_labels(cv::Mat1b & labels, const CompSize min_size) const {
+  static const unsigned int MAX_LABELS = 255;
+  // the components big enough
+  std::vector<CompIndex> kept;
+  for (CompIndex comp_idx = 0; comp_idx < (CompIndex) _run_comp_sizes.size(); ++comp_idx)
+    if (_run_comp_sizes[comp_idx] >= min_size)
+      kept.push_back(comp_idx);
+  // no more than MAX_LABELS: keep the biggest ones
+  if (kept.size() > MAX_LABELS) {
+    std::nth_element(kept.begin(), kept.begin() + MAX_LABELS, kept.end(),
+                     BiggerComp(_run_comp_sizes));
+    kept.resize(MAX_LABELS);
+    std::sort(kept.begin(), kept.end());
+  }
+  // compact the labels
+  std::vector<uchar> lut(_run_comp_sizes.size(), 0);
+  for (unsigned int kept_idx = 0; kept_idx < kept.size(); ++kept_idx)
+    lut[kept[kept_idx]] = kept_idx + 1;
+
+  labels.create(_runs_rows, _runs_cols);
+  labels.setTo(0);
+  for (unsigned int run_idx = 0; run_idx < _runs.size(); ++run_idx) {
+    const Run & run = _runs[run_idx];
+    uchar value = lut[run.label];
+    if (value == 0)
+      continue;
+    uchar* data = labels.ptr<uchar>(run.row);
+    std::fill(data + run.start_col, data + run.end_col, value);
+  } // end loop run_idx
+}
+
+////////////////////////////////////////////////////////////////////////////////
@@ -26,6 +26,16 @@ public:
 
   static const CompIndex NO_NODE = -1;
 
+  //! a horizontal run of non-null pixels, [start_col, end_col[
+  struct Run {
+    int row;
+    int start_col;
+    int end_col;
+    //! the index of the component, in [0, nb_components()[
+    CompIndex label;
+  };
+  typedef std::vector<Run> RunList;
+
   DisjointSets2(const CompIndex & new_count = 0);
   DisjointSets2(cv::Mat1b & img);
   ~DisjointSets2();
@@ -63,6 +73,49 @@ public:
      */
   cv::Point centroidOfMonochromeImage(const int cols);
 
+  /*!
+     * Labels the connected components by unioning runs instead of pixels.
+     * The equivalence tables have one entry per run,
+     * and no per-pixel array is allocated.
+     * Same connectivity as process_image() (4-connexity).
+     * Use the run getters below to get the results,
+     * not the pixel ones (get_connected_components(), biggestComponent_*()).
+     *
+     * \param img the monochrome image
+     * \param nb_blocks
+     *    if > 1, the image is cut into horizontal bands labelled in parallel,
+     *    then merged along the bands borders.
+     */
+  void process_image_runs(const cv::Mat1b & img, int nb_blocks = 1);
+
+  //! \return all the runs of the last process_image_runs(), row by row
+  inline const RunList & runs() const { return _runs; }
+
+  /*!
+     * \brief   returns the runs of each component, with their bounding boxes
+     * \param   components_runs the runs of each component
+     * \param   boundingBoxes the bounding boxes of the components
+     */
+  void get_connected_components_runs(std::vector<RunList> & components_runs,
+                                     std::vector<cv::Rect> & boundingBoxes) const;
+
+  /*!
+     * paints the labels of the runs into an image.
+     * Background is 0, component i is painted with 1 + i.
+     */
+  void get_labels(cv::Mat1i & labels) const;
+
+  /*!
+     * paints the labels of the runs into an 8 bits image.
+     * The components smaller than \a min_size pixels are dropped (painted 0).
+     * If more than 255 are left, only the 255 biggest ones are kept.
+     * The kept components are numbered from 1, in the order of their index.
+     */
+  void get_labels(cv::Mat1b & labels, const CompSize min_size = 0) const;
+
+  //! \return the number of pixels of each component (runs mode)
+  inline const std::vector<CompSize> & run_comp_sizes() const { return _run_comp_sizes; }
+
   //! for display
   void display(CompIndex width = 10);
 
@@ -102,6 +155,49 @@ private:
 
   void resize(const CompIndex & new_count, bool reset_roots = true);
 
+  //! extract the runs of rows [row_begin, row_end[ and union them locally
+  static void label_band(const cv::Mat1b & img, int row_begin, int row_end,
+                         RunList & band_runs, std::vector<CompIndex> & band_parents);
+
+  //! find with path halving on a flat equivalence table
+  static inline CompIndex find_run_root(std::vector<CompIndex> & parents,
+                                        CompIndex run_idx) {
+    while (parents[run_idx] != run_idx) {
+      parents[run_idx] = parents[parents[run_idx]];
+      run_idx = parents[run_idx];
+    }
+    return run_idx;
+  }
+
+  //! union keeping the smallest index as root, so that flattening is linear
+  static inline void union_runs(std::vector<CompIndex> & parents,
+                                CompIndex run1, CompIndex run2) {
+    CompIndex root1 = find_run_root(parents, run1);
+    CompIndex root2 = find_run_root(parents, run2);
+    if (root1 < root2)
+      parents[root2] = root1;
+    else if (root2 < root1)
+      parents[root1] = root2;
+  }
+
+  //! union the overlapping runs of two consecutive rows
+  static void union_overlapping_runs(const RunList & runs_vec,
+                                     std::vector<CompIndex> & parents,
+                                     CompIndex prev_begin, CompIndex prev_end,
+                                     CompIndex curr_begin, CompIndex curr_end);
+
+  //! runs mode: all the runs, row by row
+  RunList _runs;
+  //! runs mode: the flat equivalence table, one entry per run
+  std::vector<CompIndex> _run_parents;
+  //! runs mode: the size of each component
+  std::vector<CompSize> _run_comp_sizes;
+  //! runs mode: the runs and local equivalence tables of each band
+  std::vector<RunList> _band_runs;
+  std::vector< std::vector<CompIndex> > _band_parents;
+  //! runs mode: the size of the labelled image
+  int _runs_cols, _runs_rows;
+
 };
 
 #endif
@@ -0,0 +1,141 @@
+/*!
+  \file        distance_field.h
+  \author      Arnaud Ramey <arnaud.a.ramey@gmail.com>
+                -- Robotics Lab, University Carlos III of Madrid
+  \date        2013/10/20
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+
+\class DistanceField
+\brief The signed distance to the border of a mask, and its gradient,
+computed at a reduced resolution.
+
+The distance is positive out of the mask, negative inside,
+in pixels of the full resolution image.
+The normal is the normalized gradient of the distance:
+it points out of the mask.
+Once built, sample() is a single lookup in the reduced images,
+for instance to make particles collide with the users.
+
+ */
+
+#ifndef DISTANCE_FIELD_H
+#define DISTANCE_FIELD_H
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <math.h>
+#include <limits>
+
+class DistanceField {
+public:
+  DistanceField() : _scale(1) {}
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * Compute the field of a mask.
+   * \param mask
+   *    the inside pixels are != 0
+   * \param scale
+   *    the reduction factor, for instance 4: a 640x480 mask gives a 160x120 field
+   */
+  void build(const cv::Mat1b & mask, const int scale = 4) {
+    _scale = std::max(1, scale);
+    cv::Size small_size(std::max(1, mask.cols / _scale), std::max(1, mask.rows / _scale));
+    if (mask.empty()) {
+      _dist.release();
+      return;
+    }
+    cv::resize(mask, _inside, small_size, 0, 0, cv::INTER_NEAREST);
+    cv::threshold(_inside, _inside, 0, 255, cv::THRESH_BINARY);
+    if (cv::countNonZero(_inside) == 0) { // nothing to collide with
+      _dist.release();
+      return;
+    }
+    // distanceTransform() gives the distance to the nearest zero pixel
+    cv::bitwise_not(_inside, _outside);
+    cv::distanceTransform(_outside, _dist, CV_DIST_L2, 3);
+    cv::distanceTransform(_inside, _dist_inside, CV_DIST_L2, 3);
+    for (int row = 0; row < _dist.rows; ++row) {
+      float* dist_data = _dist.ptr<float>(row);
+      const float* inside_data = _dist_inside.ptr<float>(row);
+      for (int col = 0; col < _dist.cols; ++col)
+        dist_data[col] = _scale * (dist_data[col] - inside_data[col]);
+    } // end loop row
+
+    // the normals, by central differences
+    _normal_x.create(small_size);
+    _normal_y.create(small_size);
+    int cols = small_size.width, rows = small_size.height;
+    for (int row = 0; row < rows; ++row) {
+      const float* up = _dist.ptr<float>(std::max(0, row - 1));
+      const float* down = _dist.ptr<float>(std::min(rows - 1, row + 1));
+      const float* curr = _dist.ptr<float>(row);
+      float* nx_data = _normal_x.ptr<float>(row);
+      float* ny_data = _normal_y.ptr<float>(row);
+      for (int col = 0; col < cols; ++col) {
+        float gx = curr[std::min(cols - 1, col + 1)] - curr[std::max(0, col - 1)];
+        float gy = down[col] - up[col];
+        float norm = sqrt(gx * gx + gy * gy);
+        if (norm < 1E-3) { // a ridge: go up
+          nx_data[col] = 0;
+          ny_data[col] = -1;
+        }
+        else {
+          nx_data[col] = gx / norm;
+          ny_data[col] = gy / norm;
+        }
+      } // end loop col
+    } // end loop row
+  } // end build();
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! false if the mask was empty: sample() cannot be called
+  inline bool valid() const { return !_dist.empty(); }
+
+  /*!
+   * \param x, y
+   *    a position in the full resolution image
+   * \param dist
+   *    the signed distance to the mask border, in full resolution pixels.
+   *    Out of the image: the max float.
+   * \param nx, ny
+   *    the normal, pointing out of the mask
+   */
+  inline void sample(const float x, const float y,
+                     float & dist, float & nx, float & ny) const {
+    int col = (int) floor(x / _scale), row = (int) floor(y / _scale);
+    if (col < 0 || col >= _dist.cols || row < 0 || row >= _dist.rows) {
+      dist = std::numeric_limits<float>::max();
+      nx = 0;
+      ny = -1;
+      return;
+    }
+    dist = _dist(row, col);
+    nx = _normal_x(row, col);
+    ny = _normal_y(row, col);
+  }
+
+private:
+  int _scale;
+  cv::Mat1b _inside, _outside;
+  cv::Mat1f _dist, _dist_inside, _normal_x, _normal_y;
+}; // end class DistanceField
+
+#endif // DISTANCE_FIELD_H
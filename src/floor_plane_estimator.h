@@ -0,0 +1,301 @@
+/*!
+  \file        floor_plane_estimator.h
+  \author      Arnaud Ramey <arnaud.a.ramey@gmail.com>
+                -- Robotics Lab, University Carlos III of Madrid
+  \date        2013/10/20
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+
+\class FloorPlaneEstimator
+\brief Finds the floor plane in a depth image and masks the pixels above it.
+
+The plane is found by RANSAC on the 3D points of a subsampled grid of pixels,
+then refined by least squares on its inliers.
+It is kept between frames, and only re-estimated when too few
+of the grid points still lie on it.
+
+A 3D point is P = z * ray(u, v), with ray = ((u - cx) / fx, (v - cy) / fy, 1).
+With the plane n.P + d = 0, oriented so that the camera is on the
+positive side (d > 0), the height of a pixel above the floor is
+z * (n.ray(u, v)) + d.
+n.ray is precomputed for each pixel when the plane changes,
+so the mask costs one multiply-add per pixel.
+
+The default intrinsics are those of the Kinect (fx = fy = 525 at 640x480),
+scaled to the size of the depth image.
+
+ */
+
+#ifndef FLOOR_PLANE_ESTIMATOR_H
+#define FLOOR_PLANE_ESTIMATOR_H
+
+#include <opencv2/core/core.hpp>
+#include <vector>
+#include "nan_handling.h"
+#include "debug.h"
+
+class FloorPlaneEstimator {
+public:
+  //! the Kinect focal length, in pixels, for a 640x480 image
+  static const int KINECT_FOCAL_640 = 525;
+  //! the number of RANSAC trials
+  static const int RANSAC_ITERATIONS = 100;
+  //! the minimum number of inliers of a floor
+  static const int MIN_INLIERS = 50;
+  //! re-estimate the plane when its inliers drop below this % of the last fit
+  static const int VERIFY_INLIERS_PERCENT = 60;
+  //! the max angle between the floor normal and the camera vertical, degrees
+  static const int MAX_TILT_DEGREES = 45;
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * \param inlier_dist
+   *    in meters, the max distance of a point to the plane to be an inlier
+   * \param min_height
+   *    in meters, the height above the floor of the pixels kept by the mask
+   * \param sample_step
+   *    in pixels, the step of the grid of points used for the estimation
+   */
+  FloorPlaneEstimator(const float inlier_dist = .03,
+                      const float min_height = .05,
+                      const int sample_step = 8)
+    : _inlier_dist(inlier_dist), _min_height(min_height),
+      _sample_step(sample_step), _has_plane(false), _last_inliers(0) {}
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! forget the floor
+  inline void reset() {
+    _has_plane = false;
+    _last_inliers = 0;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * Verify the cached plane against a new depth image, re-estimate it if needed.
+   * \param depth
+   *    the depth image in meters
+   * \return true if a floor is known
+   */
+  bool update(const cv::Mat1f & depth) {
+    if (depth.size() != _size)
+      init_rays(depth.size());
+    sample_points(depth);
+    if (_has_plane) {
+      int inliers = count_inliers(_n, _d);
+      if (inliers >= MIN_INLIERS
+          && 100 * inliers >= VERIFY_INLIERS_PERCENT * _last_inliers)
+        return true;
+      maggieDebug2("FloorPlaneEstimator: floor lost (%i inliers, %i before)",
+                   inliers, _last_inliers);
+    }
+    _has_plane = ransac();
+    if (_has_plane)
+      compute_height_table();
+    return _has_plane;
+  } // end update();
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * \param depth
+   *    the depth image in meters
+   * \param mask
+   *    the output, 255 where the depth is defined and higher than
+   *    min_height above the floor. Without floor, 255 where the depth is defined.
+   */
+  void above_floor_mask(const cv::Mat1f & depth, cv::Mat1b & mask) const {
+    mask.create(depth.size());
+    bool use_plane = (_has_plane && depth.size() == _size);
+    float thresh = _min_height - _d;
+    for (int row = 0; row < depth.rows; ++row) {
+      const float* depth_data = depth.ptr<float>(row);
+      const float* k_data = (use_plane ? _height_k.ptr<float>(row) : NULL);
+      uchar* mask_data = mask.ptr<uchar>(row);
+      for (int col = 0; col < depth.cols; ++col) {
+        float z = depth_data[col];
+        bool valid = !image_utils::is_nan_depth(z);
+        if (use_plane)
+          valid = valid && (z * k_data[col] > thresh);
+        mask_data[col] = (valid ? 255 : 0);
+      } // end loop col
+    } // end loop row
+  } // end above_floor_mask();
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  inline bool has_plane() const { return _has_plane; }
+  //! the unit normal n of the plane n.P + d = 0, pointing to the camera
+  inline const cv::Point3f & normal() const { return _n; }
+  //! the height of the camera above the floor, in meters
+  inline float d() const { return _d; }
+
+private:
+  //////////////////////////////////////////////////////////////////////////////
+
+  void init_rays(const cv::Size & size) {
+    _size = size;
+    _has_plane = false;
+    float f = 1.f * KINECT_FOCAL_640 * size.width / 640;
+    float cx = (size.width - 1) / 2.f, cy = (size.height - 1) / 2.f;
+    _ray_x.resize(size.width);
+    for (int col = 0; col < size.width; ++col)
+      _ray_x[col] = (col - cx) / f;
+    _ray_y.resize(size.height);
+    for (int row = 0; row < size.height; ++row)
+      _ray_y[row] = (row - cy) / f;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! n.ray for each pixel
+  void compute_height_table() {
+    _height_k.create(_size);
+    for (int row = 0; row < _size.height; ++row) {
+      float* k_data = _height_k.ptr<float>(row);
+      float row_k = _n.y * _ray_y[row] + _n.z;
+      for (int col = 0; col < _size.width; ++col)
+        k_data[col] = _n.x * _ray_x[col] + row_k;
+    } // end loop row
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  void sample_points(const cv::Mat1f & depth) {
+    _pts.clear();
+    for (int row = _sample_step / 2; row < depth.rows; row += _sample_step) {
+      const float* depth_data = depth.ptr<float>(row);
+      for (int col = _sample_step / 2; col < depth.cols; col += _sample_step) {
+        float z = depth_data[col];
+        if (!image_utils::is_nan_depth(z))
+          _pts.push_back(cv::Point3f(z * _ray_x[col], z * _ray_y[row], z));
+      } // end loop col
+    } // end loop row
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  inline int count_inliers(const cv::Point3f & n, const float d) const {
+    int inliers = 0;
+    for (unsigned int pt_idx = 0; pt_idx < _pts.size(); ++pt_idx) {
+      if (fabs(n.dot(_pts[pt_idx]) + d) < _inlier_dist)
+        ++inliers;
+    }
+    return inliers;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! \return true if a plane was found. Sets _n, _d, _last_inliers
+  bool ransac() {
+    int npts = _pts.size();
+    if (npts < MIN_INLIERS)
+      return false;
+    float min_cos_tilt = cos(MAX_TILT_DEGREES * M_PI / 180);
+    int best_inliers = 0;
+    cv::Point3f best_n;
+    float best_d = 0;
+    for (int iter = 0; iter < RANSAC_ITERATIONS; ++iter) {
+      const cv::Point3f & p1 = _pts[_rng.uniform(0, npts)],
+          & p2 = _pts[_rng.uniform(0, npts)], & p3 = _pts[_rng.uniform(0, npts)];
+      cv::Point3f n = (p2 - p1).cross(p3 - p1);
+      float norm = sqrt(n.dot(n));
+      if (norm < 1E-6)
+        continue;
+      n = n * (1. / norm);
+      float d = -n.dot(p1);
+      if (d < 0) { // orient towards the camera
+        n = n * -1.;
+        d = -d;
+      }
+      // the camera y axis points down: the floor normal points up
+      if (-n.y < min_cos_tilt)
+        continue;
+      int inliers = count_inliers(n, d);
+      if (inliers > best_inliers) {
+        best_inliers = inliers;
+        best_n = n;
+        best_d = d;
+      }
+    } // end loop iter
+    if (best_inliers < MIN_INLIERS)
+      return false;
+    _n = best_n;
+    _d = best_d;
+    refine();
+    _last_inliers = count_inliers(_n, _d);
+    maggieDebug2("FloorPlaneEstimator: floor n=(%g, %g, %g), d=%g, %i inliers",
+                 _n.x, _n.y, _n.z, _d, _last_inliers);
+    return true;
+  } // end ransac();
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * Least squares fit of y = a x + b z + c on the inliers of the plane:
+   * the floor is never parallel to the y axis of the camera.
+   */
+  void refine() {
+    double sxx = 0, sxz = 0, szz = 0, sx = 0, sz = 0, n = 0,
+        sxy = 0, szy = 0, sy = 0;
+    for (unsigned int pt_idx = 0; pt_idx < _pts.size(); ++pt_idx) {
+      const cv::Point3f & p = _pts[pt_idx];
+      if (fabs(_n.dot(p) + _d) >= _inlier_dist)
+        continue;
+      sxx += p.x * p.x; sxz += p.x * p.z; szz += p.z * p.z;
+      sx += p.x; sz += p.z; n += 1;
+      sxy += p.x * p.y; szy += p.z * p.y; sy += p.y;
+    } // end loop pt_idx
+    // solve [sxx sxz sx; sxz szz sz; sx sz n] [a b c]' = [sxy szy sy]'
+    double det = sxx * (szz * n - sz * sz) - sxz * (sxz * n - sz * sx)
+        + sx * (sxz * sz - szz * sx);
+    if (fabs(det) < 1E-9)
+      return;
+    double a = (sxy * (szz * n - sz * sz) - sxz * (szy * n - sz * sy)
+                + sx * (szy * sz - szz * sy)) / det;
+    double b = (sxx * (szy * n - sz * sy) - sxy * (sxz * n - sz * sx)
+                + sx * (sxz * sy - szy * sx)) / det;
+    double c = (sxx * (szz * sy - szy * sz) - sxz * (sxz * sy - szy * sx)
+                + sxy * (sxz * sz - szz * sx)) / det;
+    // a x - y + b z + c = 0, normalized and oriented towards the camera
+    double norm = sqrt(a * a + 1 + b * b);
+    if (c < 0)
+      norm = -norm;
+    _n = cv::Point3f(a / norm, -1 / norm, b / norm);
+    _d = c / norm;
+  } // end refine();
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  float _inlier_dist;
+  float _min_height;
+  int _sample_step;
+  cv::Size _size;
+  std::vector<float> _ray_x, _ray_y;
+  std::vector<cv::Point3f> _pts;
+  cv::RNG _rng;
+  bool _has_plane;
+  cv::Point3f _n;
+  float _d;
+  int _last_inliers;
+  //! n.ray for each pixel
+  cv::Mat1f _height_k;
+}; // end class FloorPlaneEstimator
+
+#endif // FLOOR_PLANE_ESTIMATOR_H
@@ -0,0 +1,296 @@
+/*!
+  \file        joint_kinematics.h
+  \author      Arnaud Ramey <arnaud.a.ramey@gmail.com>
+                -- Robotics Lab, University Carlos III of Madrid
+  \date        2013/10/20
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+
+\class JointKinematics
+\brief The filtered position, velocity and acceleration of the joints
+of the tracked skeletons.
+
+Each coordinate of each joint goes through a One-Euro filter
+(Casiez et al., CHI 2012): a low-pass filter whose cutoff frequency
+increases with the speed, so that the joints are steady when still,
+and have little lag when moving fast.
+The velocity is the filtered derivative of the filtered position,
+the acceleration the filtered derivative of the velocity.
+The last positions are kept in a fixed-size ring, for trails.
+
+Both the 3D position (meters) and the image position
+(normalized in [0, 1], as \a NiteSkeletonJoint::pose2D) are filtered.
+An update costs O(joints).
+
+ */
+
+#ifndef JOINT_KINEMATICS_H
+#define JOINT_KINEMATICS_H
+
+#include <map>
+#include <algorithm>
+#include <math.h>
+#include <opencv2/core/core.hpp>
+#ifdef NITE_FX
+#include "NiteSkeletonLite.h"
+#else  // not NITE_FX
+#include <kinect/NiteSkeletonList.h>
+#endif // not NITE_FX
+
+class OneEuroFilter {
+public:
+  /*!
+   * \param min_cutoff
+   *    the cutoff frequency when still, in Hz. Lower = less jitter.
+   * \param beta
+   *    how fast the cutoff increases with the speed. Higher = less lag.
+   * \param d_cutoff
+   *    the cutoff frequency of the derivative, in Hz
+   */
+  OneEuroFilter(const double min_cutoff = 1, const double beta = 0,
+                const double d_cutoff = 1)
+    : _min_cutoff(min_cutoff), _beta(beta), _d_cutoff(d_cutoff) {
+    reset();
+  }
+
+  inline void reset() {
+    _initialized = false;
+    _x = _dx = _velocity = 0;
+  }
+
+  //! filter a new sample, \a dt seconds after the previous one
+  inline double filter(const double x, const double dt) {
+    if (!_initialized || dt <= 0) {
+      if (!_initialized)
+        _x = x;
+      _dx = _velocity = 0;
+      _initialized = true;
+      return _x;
+    }
+    double d_alpha = alpha(_d_cutoff, dt);
+    // the speed estimate that drives the cutoff
+    _dx += d_alpha * ((x - _x) / dt - _dx);
+    double cutoff = _min_cutoff + _beta * fabs(_dx);
+    double prev_x = _x;
+    _x += alpha(cutoff, dt) * (x - _x);
+    _velocity += d_alpha * ((_x - prev_x) / dt - _velocity);
+    return _x;
+  }
+
+  //! the last filtered value
+  inline double value() const { return _x; }
+  //! the low-passed derivative of the filtered value
+  inline double derivative() const { return _velocity; }
+
+private:
+  static inline double alpha(const double cutoff, const double dt) {
+    double tau = 1. / (2 * M_PI * cutoff);
+    return 1. / (1. + tau / dt);
+  }
+
+  double _min_cutoff, _beta, _d_cutoff;
+  bool _initialized;
+  double _x, _dx, _velocity;
+}; // end class OneEuroFilter
+
+////////////////////////////////////////////////////////////////////////////////
+
+class JointKinematics {
+public:
+  typedef kinect::NiteSkeletonJoint NSJ;
+  static const int MAX_JOINTS = kinect::NiteSkeleton::SKEL_MAX_JOINTS;
+  //! the number of past positions kept for each joint
+  static const int HISTORY_SIZE = 8;
+  //! x, y, z in meters, then u, v in the image
+  static const int NCOORDS = 5;
+
+  struct JointState {
+    //! true if the joint was seen with enough confidence in the last update
+    bool tracked;
+    //! the time of the last update, in seconds
+    double timestamp;
+    float confidence;
+    //! meters, m/s, m/s^2
+    cv::Point3f position, velocity, acceleration;
+    //! in the image, normalized in [0, 1] (multiply by the image size)
+    cv::Point2f image_position, image_velocity, image_acceleration;
+    //! the last image positions, the newest at history_head
+    cv::Point2f image_history[HISTORY_SIZE];
+    int history_head, history_size;
+
+    //! the \a age-th last image position, 0 for the newest
+    inline const cv::Point2f & image_history_at(const int age) const {
+      return image_history[(history_head + HISTORY_SIZE - age) % HISTORY_SIZE];
+    }
+  }; // end struct JointState
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * \param min_confidence
+   *    the joints with a lower confidence are not updated
+   * \param min_cutoff, beta, d_cutoff
+   *    the One-Euro parameters of the positions.
+   *    The image coordinates use a \a beta scaled to be comparable.
+   */
+  JointKinematics(const float min_confidence = .5,
+                  const double min_cutoff = 1, const double beta = 1,
+                  const double d_cutoff = 1)
+    : _min_confidence(min_confidence), _min_cutoff(min_cutoff), _beta(beta),
+      _d_cutoff(d_cutoff) {}
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * Update with the skeletons of a new frame.
+   * The users that are not in \a skeleton_list are forgotten,
+   * the joints that are not in it are not tracked.
+   * The joints given again at the same time keep their state.
+   * \param now
+   *    the time of the frame, in seconds
+   */
+  void update(const kinect::NiteSkeletonList & skeleton_list, const double now) {
+    // forget the lost users
+    UserMap::iterator user_it = _users.begin();
+    while (user_it != _users.end()) {
+      bool found = false;
+      for (unsigned int i = 0; i < skeleton_list.skeletons.size() && !found; ++i)
+        found = (skeleton_list.skeletons[i].user_id == user_it->first);
+      if (found)
+        ++user_it;
+      else
+        _users.erase(user_it++);
+    } // end while (user_it)
+
+    for (unsigned int skel_idx = 0; skel_idx < skeleton_list.skeletons.size(); ++skel_idx) {
+      const kinect::NiteSkeleton & skel = skeleton_list.skeletons[skel_idx];
+      UserMap::iterator it = _users.find(skel.user_id);
+      if (it == _users.end())
+        it = _users.insert(std::make_pair(skel.user_id, UserKinematics(*this))).first;
+      UserKinematics & user = it->second;
+      bool seen[MAX_JOINTS];
+      std::fill(seen, seen + MAX_JOINTS, false);
+      for (unsigned int joint_idx = 0; joint_idx < skel.joints.size(); ++joint_idx) {
+        const NSJ & joint = skel.joints[joint_idx];
+        if (joint.joint_id < 0 || joint.joint_id >= MAX_JOINTS
+            || joint.confidence < _min_confidence)
+          continue;
+        seen[joint.joint_id] = true;
+        update_joint(joint, now, user.states[joint.joint_id],
+                     &(user.filters[NCOORDS * joint.joint_id]),
+                     &(user.acc_filters[NCOORDS * joint.joint_id]));
+      } // end loop joint_idx
+      // the joints missing in this frame are lost
+      for (int joint_id = 0; joint_id < MAX_JOINTS; ++joint_id) {
+        if (!seen[joint_id])
+          user.states[joint_id].tracked = false;
+      }
+    } // end loop skel_idx
+  } // end update();
+
+  //! update with the skeletons of a new frame, at the time of their header
+  inline void update(const kinect::NiteSkeletonList & skeleton_list) {
+#ifdef NITE_FX
+    update(skeleton_list, skeleton_list.header.stamp);
+#else  // not NITE_FX
+    update(skeleton_list, skeleton_list.header.stamp.toSec());
+#endif // not NITE_FX
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! \return the state of a joint, NULL if the user is unknown
+  inline const JointState* get(const int user_id,
+                               const int joint_id) const {
+    UserMap::const_iterator it = _users.find(user_id);
+    if (it == _users.end() || joint_id < 0 || joint_id >= MAX_JOINTS)
+      return NULL;
+    return &(it->second.states[joint_id]);
+  }
+
+  //! the ids of the known users
+  inline void user_ids(std::vector<int> & out) const {
+    out.clear();
+    for (UserMap::const_iterator it = _users.begin(); it != _users.end(); ++it)
+      out.push_back(it->first);
+  }
+
+private:
+  //////////////////////////////////////////////////////////////////////////////
+
+  struct UserKinematics {
+    UserKinematics(const JointKinematics & k) {
+      for (int joint_id = 0; joint_id < MAX_JOINTS; ++joint_id) {
+        states[joint_id].tracked = false;
+        states[joint_id].timestamp = -1;
+        states[joint_id].history_head = states[joint_id].history_size = 0;
+        for (int coord = 0; coord < NCOORDS; ++coord) {
+          // the image is about 3 meters wide
+          double beta = (coord < 3 ? k._beta : 3 * k._beta);
+          filters[NCOORDS * joint_id + coord] =
+              OneEuroFilter(k._min_cutoff, beta, k._d_cutoff);
+          acc_filters[NCOORDS * joint_id + coord] =
+              OneEuroFilter(k._d_cutoff, 0, k._d_cutoff);
+        }
+      } // end loop joint_id
+    }
+    JointState states[MAX_JOINTS];
+    //! the filters of the positions, NCOORDS per joint
+    OneEuroFilter filters[NCOORDS * MAX_JOINTS];
+    //! the filters of the velocities, whose derivative is the acceleration
+    OneEuroFilter acc_filters[NCOORDS * MAX_JOINTS];
+  }; // end struct UserKinematics
+  typedef std::map<int, UserKinematics> UserMap;
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  static void update_joint(const NSJ & joint, const double now, JointState & s,
+                           OneEuroFilter* filters, OneEuroFilter* acc_filters) {
+    double dt = (s.timestamp < 0 ? 0 : now - s.timestamp);
+    if (s.timestamp >= 0 && dt <= 0) // same frame twice: keep the state
+      return;
+    double raw[NCOORDS] = { joint.pose3D.position.x, joint.pose3D.position.y,
+                            joint.pose3D.position.z, joint.pose2D.x, joint.pose2D.y };
+    double pos[NCOORDS], vel[NCOORDS], acc[NCOORDS];
+    for (int coord = 0; coord < NCOORDS; ++coord) {
+      pos[coord] = filters[coord].filter(raw[coord], dt);
+      vel[coord] = filters[coord].derivative();
+      acc_filters[coord].filter(vel[coord], dt);
+      acc[coord] = acc_filters[coord].derivative();
+    } // end loop coord
+    s.tracked = true;
+    s.timestamp = now;
+    s.confidence = joint.confidence;
+    s.position = cv::Point3f(pos[0], pos[1], pos[2]);
+    s.velocity = cv::Point3f(vel[0], vel[1], vel[2]);
+    s.acceleration = cv::Point3f(acc[0], acc[1], acc[2]);
+    s.image_position = cv::Point2f(pos[3], pos[4]);
+    s.image_velocity = cv::Point2f(vel[3], vel[4]);
+    s.image_acceleration = cv::Point2f(acc[3], acc[4]);
+    s.history_head = (s.history_head + 1) % HISTORY_SIZE;
+    s.image_history[s.history_head] = s.image_position;
+    s.history_size = std::min(s.history_size + 1, (int) HISTORY_SIZE);
+  } // end update_joint();
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  float _min_confidence;
+  double _min_cutoff, _beta, _d_cutoff;
+  UserMap _users;
+}; // end class JointKinematics
+
+#endif // JOINT_KINEMATICS_H
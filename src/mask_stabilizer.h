@@ -0,0 +1,137 @@
+/*!
+  \file        mask_stabilizer.h
+  \author      Arnaud Ramey <arnaud.a.ramey@gmail.com>
+                -- Robotics Lab, University Carlos III of Madrid
+  \date        2013/10/20
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+
+\class MaskStabilizer
+\brief Removes the flicker of a user map with a temporal hysteresis.
+
+Each pixel has a saturating uchar counter, increased by \a up when the pixel
+belongs to a user, decreased by \a down otherwise.
+A pixel enters the stable mask when its counter reaches \a enter,
+and leaves it when its counter falls to \a exit.
+The stable pixels keep the last user label they had.
+
+With SSE2, 16 pixels are updated at once.
+
+ */
+
+#ifndef MASK_STABILIZER_H
+#define MASK_STABILIZER_H
+
+#include <opencv2/core/core.hpp>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif // __SSE2__
+
+class MaskStabilizer {
+public:
+  /*!
+   * The defaults need 3 frames to enter or leave the stable mask.
+   * \param up, down
+   *    the increment and decrement of the counters
+   * \param enter, exit
+   *    the hysteresis thresholds, with enter > exit
+   */
+  MaskStabilizer(const uchar up = 64, const uchar down = 64,
+                 const uchar enter = 192, const uchar exit = 64)
+    : _up(up), _down(down), _enter(enter), _exit(exit) {}
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! forget the history
+  inline void reset() { _counters.release(); }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * \param user
+   *    the raw user map of the frame
+   * \param out
+   *    the stabilized user map, cannot be \a user
+   */
+  void apply(const cv::Mat1b & user, cv::Mat1b & out) {
+    if (_counters.size() != user.size()) {
+      _counters.create(user.size());
+      _counters.setTo(0);
+      _state.create(user.size());
+      _state.setTo(0);
+      _labels.create(user.size());
+      _labels.setTo(0);
+    }
+    out.create(user.size());
+    for (int row = 0; row < user.rows; ++row) {
+      const uchar* user_data = user.ptr<uchar>(row);
+      uchar* counter_data = _counters.ptr<uchar>(row);
+      uchar* state_data = _state.ptr<uchar>(row);
+      uchar* label_data = _labels.ptr<uchar>(row);
+      uchar* out_data = out.ptr<uchar>(row);
+      int col = 0;
+#ifdef __SSE2__
+      const __m128i zero = _mm_setzero_si128(), up = _mm_set1_epi8(_up),
+          down = _mm_set1_epi8(_down), enter = _mm_set1_epi8(_enter),
+          exit = _mm_set1_epi8(_exit);
+      for (; col + 16 <= user.cols; col += 16) {
+        __m128i raw = _mm_loadu_si128((const __m128i*) (user_data + col));
+        __m128i c = _mm_loadu_si128((const __m128i*) (counter_data + col));
+        __m128i state = _mm_loadu_si128((const __m128i*) (state_data + col));
+        __m128i label = _mm_loadu_si128((const __m128i*) (label_data + col));
+        // 0xFF where the raw pixel is a background pixel
+        __m128i bg = _mm_cmpeq_epi8(raw, zero);
+        c = _mm_or_si128(_mm_andnot_si128(bg, _mm_adds_epu8(c, up)),
+                         _mm_and_si128(bg, _mm_subs_epu8(c, down)));
+        // unsigned comparisons: c >= enter <=> max(c, enter) == c
+        __m128i entered = _mm_cmpeq_epi8(_mm_max_epu8(c, enter), c);
+        __m128i exited = _mm_cmpeq_epi8(_mm_min_epu8(c, exit), c);
+        state = _mm_or_si128(entered, _mm_andnot_si128(exited, state));
+        label = _mm_or_si128(_mm_andnot_si128(bg, raw), _mm_and_si128(bg, label));
+        _mm_storeu_si128((__m128i*) (counter_data + col), c);
+        _mm_storeu_si128((__m128i*) (state_data + col), state);
+        _mm_storeu_si128((__m128i*) (label_data + col), label);
+        _mm_storeu_si128((__m128i*) (out_data + col), _mm_and_si128(state, label));
+      } // end loop col
+#endif // __SSE2__
+      for (; col < user.cols; ++col) {
+        uchar raw = user_data[col];
+        int c = counter_data[col];
+        c = (raw != 0 ? std::min(c + _up, 255) : std::max(c - _down, 0));
+        counter_data[col] = c;
+        if (c >= _enter)
+          state_data[col] = 255;
+        else if (c <= _exit)
+          state_data[col] = 0;
+        if (raw != 0)
+          label_data[col] = raw;
+        out_data[col] = state_data[col] & label_data[col];
+      } // end loop col
+    } // end loop row
+  } // end apply();
+
+private:
+  int _up, _down, _enter, _exit;
+  //! the saturating counters
+  cv::Mat1b _counters;
+  //! 255 for the pixels in the stable mask
+  cv::Mat1b _state;
+  //! the last user label of each pixel
+  cv::Mat1b _labels;
+}; // end class MaskStabilizer
+
+#endif // MASK_STABILIZER_H
@@ -0,0 +1,474 @@
+/*!
+  \file        morph_utils.h
+  \author      Arnaud Ramey <arnaud.a.ramey@gmail.com>
+                -- Robotics Lab, University Carlos III of Madrid
+  \date        2013/10/20
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+
+Erosion, dilation, opening and closing of masks with rectangular kernels,
+with a cost that does not depend on the kernel size.
+
+They use the separable van Herk / Gil-Werman algorithm:
+each 1D pass computes, in blocks of the kernel size,
+running min/max from the left and from the right,
+and each output value is the min/max of two of them.
+That is 3 comparisons per pixel and per pass, whatever the kernel size.
+
+The results are the same as cv::erode() / cv::dilate() / cv::morphologyEx()
+with a full rectangular kernel of the same size, the default anchor
+(the kernel center) and the default border (pixels outside of the image
+are ignored).
+
+Masks can also be bit-packed (\a BitMask, 64 pixels per word).
+The vertical pass is then done on whole words (64 pixels at a time),
+the horizontal one by shift-and-combine in O(log(kernel width)) per word.
+
+ */
+
+#ifndef MORPH_UTILS_H
+#define MORPH_UTILS_H
+
+#include <opencv2/core/core.hpp>
+#include <vector>
+
+namespace image_utils {
+
+//! min / max on uchar: erosion / dilation of grayscale masks
+struct MorphMinOp {
+  typedef uchar Type;
+  static inline uchar op(const uchar a, const uchar b) { return (a < b ? a : b); }
+  static inline uchar neutral() { return 255; }
+};
+struct MorphMaxOp {
+  typedef uchar Type;
+  static inline uchar op(const uchar a, const uchar b) { return (a > b ? a : b); }
+  static inline uchar neutral() { return 0; }
+};
+//! and / or on words: erosion / dilation of bit-packed masks
+struct MorphAndOp {
+  typedef uint64_t Type;
+  static inline uint64_t op(const uint64_t a, const uint64_t b) { return a & b; }
+  static inline uint64_t neutral() { return ~((uint64_t) 0); }
+};
+struct MorphOrOp {
+  typedef uint64_t Type;
+  static inline uint64_t op(const uint64_t a, const uint64_t b) { return a | b; }
+  static inline uint64_t neutral() { return 0; }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*!
+ * A mask with one bit per pixel, 64 pixels per word.
+ * Pixel (row, col) is the bit (col % 64) of the word (row, col / 64).
+ * The padding bits at the end of each row are always 0.
+ */
+class BitMask {
+public:
+  BitMask() : rows(0), cols(0), words_per_row(0) {}
+
+  inline void create(const int new_rows, const int new_cols) {
+    rows = new_rows;
+    cols = new_cols;
+    words_per_row = (cols + 63) / 64;
+    data.resize(rows * words_per_row);
+  }
+  inline bool empty() const { return data.empty(); }
+  inline uint64_t* row(const int r) { return &(data[r * words_per_row]); }
+  inline const uint64_t* row(const int r) const { return &(data[r * words_per_row]); }
+  //! the mask of the valid bits of the last word of each row
+  inline uint64_t last_word_mask() const {
+    int nbits = cols - 64 * (words_per_row - 1);
+    return (nbits == 64 ? ~((uint64_t) 0) : (((uint64_t) 1 << nbits) - 1));
+  }
+
+  int rows, cols, words_per_row;
+  std::vector<uint64_t> data;
+}; // end class BitMask
+
+////////////////////////////////////////////////////////////////////////////////
+
+//! pack a mask into bits: non-null pixels become 1
+inline void pack_mask(const cv::Mat1b & src, BitMask & dst) {
+  dst.create(src.rows, src.cols);
+  for (int row = 0; row < src.rows; ++row) {
+    const uchar* src_data = src.ptr<uchar>(row);
+    uint64_t* dst_data = dst.row(row);
+    for (int word = 0; word < dst.words_per_row; ++word) {
+      uint64_t value = 0;
+      int col_begin = 64 * word, col_end = std::min(src.cols, col_begin + 64);
+      for (int col = col_begin; col < col_end; ++col)
+        value |= (uint64_t) (src_data[col] != 0) << (col - col_begin);
+      dst_data[word] = value;
+    } // end loop word
+  } // end loop row
+}
+
+//! unpack bits into a mask: 1 bits become \a on_value, 0 bits become 0
+inline void unpack_mask(const BitMask & src, cv::Mat1b & dst,
+                        const uchar on_value = 255) {
+  dst.create(src.rows, src.cols);
+  for (int row = 0; row < src.rows; ++row) {
+    const uint64_t* src_data = src.row(row);
+    uchar* dst_data = dst.ptr<uchar>(row);
+    for (int col = 0; col < src.cols; ++col)
+      dst_data[col] = ((src_data[col >> 6] >> (col & 63)) & 1 ? on_value : 0);
+  } // end loop row
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*!
+ * The buffers needed by the morphological operations.
+ * Keep one of them alive between frames to avoid reallocations.
+ */
+class MaskMorphology {
+public:
+  //! erosion by a kw x kh rectangle. \a src and \a dst can be the same.
+  inline void erode_rect(const cv::Mat1b & src, cv::Mat1b & dst,
+                         const int kw, const int kh) {
+    filter2d<MorphMinOp>(src, dst, kw, kh);
+  }
+  //! dilation by a kw x kh rectangle. \a src and \a dst can be the same.
+  inline void dilate_rect(const cv::Mat1b & src, cv::Mat1b & dst,
+                          const int kw, const int kh) {
+    filter2d<MorphMaxOp>(src, dst, kw, kh);
+  }
+  //! opening (erosion then dilation) by a kw x kh rectangle
+  inline void open_rect(const cv::Mat1b & src, cv::Mat1b & dst,
+                        const int kw, const int kh) {
+    erode_rect(src, dst, kw, kh);
+    dilate_rect(dst, dst, kw, kh);
+  }
+  //! closing (dilation then erosion) by a kw x kh rectangle
+  inline void close_rect(const cv::Mat1b & src, cv::Mat1b & dst,
+                         const int kw, const int kh) {
+    dilate_rect(src, dst, kw, kh);
+    erode_rect(dst, dst, kw, kh);
+  }
+
+  //! erosion of a bit-packed mask. \a src and \a dst can be the same.
+  inline void erode_rect(const BitMask & src, BitMask & dst,
+                         const int kw, const int kh) {
+    filter2d_bits<MorphAndOp>(src, dst, kw, kh);
+  }
+  //! dilation of a bit-packed mask. \a src and \a dst can be the same.
+  inline void dilate_rect(const BitMask & src, BitMask & dst,
+                          const int kw, const int kh) {
+    filter2d_bits<MorphOrOp>(src, dst, kw, kh);
+  }
+  inline void open_rect(const BitMask & src, BitMask & dst,
+                        const int kw, const int kh) {
+    erode_rect(src, dst, kw, kh);
+    dilate_rect(dst, dst, kw, kh);
+  }
+  inline void close_rect(const BitMask & src, BitMask & dst,
+                         const int kw, const int kh) {
+    dilate_rect(src, dst, kw, kh);
+    erode_rect(dst, dst, kw, kh);
+  }
+
+private:
+  /*!
+   * 1D van Herk / Gil-Werman filter of a line of n values.
+   * dst[x] = op(src[x - anchor], ..., src[x - anchor + k - 1])
+   */
+  template<class Op>
+  static inline void vhgw_line(const typename Op::Type* src,
+                               typename Op::Type* dst,
+                               const int n, const int k,
+                               std::vector<typename Op::Type> & g,
+                               std::vector<typename Op::Type> & h) {
+    typedef typename Op::Type T;
+    int anchor = k / 2, len = ((n + k - 1 + k - 1) / k) * k;
+    g.resize(len);
+    h.resize(len);
+    // padded line: buf[i] = src[i - anchor]
+    // g: running op from the start of each block
+    for (int i = 0; i < len; ++i) {
+      int src_idx = i - anchor;
+      T value = (src_idx >= 0 && src_idx < n ? src[src_idx] : Op::neutral());
+      g[i] = (i % k == 0 ? value : Op::op(g[i - 1], value));
+      h[i] = value;
+    } // end loop i
+    // h: running op from the end of each block
+    for (int i = len - 2; i >= 0; --i) {
+      if ((i + 1) % k != 0)
+        h[i] = Op::op(h[i], h[i + 1]);
+    } // end loop i
+    for (int x = 0; x < n; ++x)
+      dst[x] = Op::op(h[x], g[x + k - 1]);
+  } // end vhgw_line()
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * 1D van Herk / Gil-Werman filter along the columns,
+   * done on whole rows at once so that the inner loops are contiguous.
+   * \param src_rows, dst_rows the addresses of the nrows rows of width values
+   */
+  template<class Op>
+  inline void vhgw_columns(const std::vector<const typename Op::Type*> & src_rows,
+                           const std::vector<typename Op::Type*> & dst_rows,
+                           const int width, const int k,
+                           std::vector<typename Op::Type> & g,
+                           std::vector<typename Op::Type> & h,
+                           std::vector<typename Op::Type> & neutral_row) {
+    typedef typename Op::Type T;
+    int nrows = src_rows.size();
+    int anchor = k / 2, len = ((nrows + k - 1 + k - 1) / k) * k;
+    g.resize(len * width);
+    h.resize(len * width);
+    neutral_row.assign(width, Op::neutral());
+    for (int i = 0; i < len; ++i) {
+      int src_idx = i - anchor;
+      const T* value = (src_idx >= 0 && src_idx < nrows ?
+                          src_rows[src_idx] : &(neutral_row[0]));
+      T* g_row = &(g[i * width]);
+      T* h_row = &(h[i * width]);
+      if (i % k == 0)
+        std::copy(value, value + width, g_row);
+      else {
+        const T* g_prev = g_row - width;
+        for (int col = 0; col < width; ++col)
+          g_row[col] = Op::op(g_prev[col], value[col]);
+      }
+      std::copy(value, value + width, h_row);
+    } // end loop i
+    for (int i = len - 2; i >= 0; --i) {
+      if ((i + 1) % k == 0)
+        continue;
+      T* h_row = &(h[i * width]);
+      const T* h_next = h_row + width;
+      for (int col = 0; col < width; ++col)
+        h_row[col] = Op::op(h_row[col], h_next[col]);
+    } // end loop i
+    for (int row = 0; row < nrows; ++row) {
+      const T* h_row = &(h[row * width]);
+      const T* g_row = &(g[(row + k - 1) * width]);
+      T* dst_row = dst_rows[row];
+      for (int col = 0; col < width; ++col)
+        dst_row[col] = Op::op(h_row[col], g_row[col]);
+    } // end loop row
+  } // end vhgw_columns()
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  template<class Op>
+  inline void filter2d(const cv::Mat1b & src, cv::Mat1b & dst,
+                       const int kw, const int kh) {
+    if (src.empty()) {
+      dst.create(src.size());
+      return;
+    }
+    // horizontal pass: src -> _tmp
+    _tmp.create(src.size());
+    for (int row = 0; row < src.rows; ++row) {
+      if (kw <= 1)
+        std::copy(src.ptr<uchar>(row), src.ptr<uchar>(row) + src.cols,
+                  _tmp.ptr<uchar>(row));
+      else
+        vhgw_line<Op>(src.ptr<uchar>(row), _tmp.ptr<uchar>(row), src.cols, kw,
+                      _g8, _h8);
+    } // end loop row
+    // vertical pass: _tmp -> dst
+    dst.create(src.size());
+    if (kh <= 1) {
+      _tmp.copyTo(dst);
+      return;
+    }
+    _src_rows8.resize(src.rows);
+    _dst_rows8.resize(src.rows);
+    for (int row = 0; row < src.rows; ++row) {
+      _src_rows8[row] = _tmp.ptr<uchar>(row);
+      _dst_rows8[row] = dst.ptr<uchar>(row);
+    }
+    vhgw_columns<Op>(_src_rows8, _dst_rows8, src.cols, kh, _g8, _h8, _neutral8);
+  } // end filter2d()
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! out bit x = in bit (x + shift), or fill if out of the row. shift >= 0
+  static inline void shift_row_down(const uint64_t* in, uint64_t* out,
+                                    const int nwords, const int shift,
+                                    const uint64_t fill) {
+    int ws = shift >> 6, bs = shift & 63;
+    for (int w = 0; w < nwords; ++w) {
+      uint64_t lo = (w + ws < nwords ? in[w + ws] : fill);
+      uint64_t hi = (w + ws + 1 < nwords ? in[w + ws + 1] : fill);
+      out[w] = (bs == 0 ? lo : ((lo >> bs) | (hi << (64 - bs))));
+    }
+  }
+
+  //! out bit x = in bit (x - shift), or fill if out of the row. shift >= 0
+  static inline void shift_row_up(const uint64_t* in, uint64_t* out,
+                                  const int nwords, const int shift,
+                                  const uint64_t fill) {
+    int ws = shift >> 6, bs = shift & 63;
+    for (int w = nwords - 1; w >= 0; --w) {
+      uint64_t hi = (w - ws >= 0 ? in[w - ws] : fill);
+      uint64_t lo = (w - ws - 1 >= 0 ? in[w - ws - 1] : fill);
+      out[w] = (bs == 0 ? hi : ((hi << bs) | (lo >> (64 - bs))));
+    }
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * in place: s(x) = op(s(x), ..., s(x + span - 1)) if down,
+   *           s(x) = op(s(x - span + 1), ..., s(x)) otherwise,
+   * by doubling the span: O(log(span)) per word.
+   */
+  template<class Op>
+  static inline void accumulate_span(uint64_t* s, uint64_t* shifted,
+                                     const int nwords, const int span,
+                                     const bool down) {
+    uint64_t fill = Op::neutral();
+    int curr_span = 1;
+    while (curr_span < span) {
+      // overlapping windows are fine for and / or
+      int shift = std::min(curr_span, span - curr_span);
+      if (down)
+        shift_row_down(s, shifted, nwords, shift, fill);
+      else
+        shift_row_up(s, shifted, nwords, shift, fill);
+      for (int w = 0; w < nwords; ++w)
+        s[w] = Op::op(s[w], shifted[w]);
+      curr_span += shift;
+    } // end while (curr_span < span)
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  template<class Op>
+  inline void filter2d_bits(const BitMask & src, BitMask & dst,
+                            const int kw, const int kh) {
+    if (src.rows == 0 || src.cols == 0) {
+      dst.create(src.rows, src.cols);
+      return;
+    }
+    int nwords = src.words_per_row;
+    uint64_t last_mask = src.last_word_mask(), fill = Op::neutral();
+    // horizontal pass: src -> _tmp_bits, by doubling shifts
+    _tmp_bits.create(src.rows, src.cols);
+    _s.resize(nwords);
+    _shifted.resize(nwords);
+    for (int row = 0; row < src.rows; ++row) {
+      uint64_t* s = &(_s[0]), *shifted = &(_shifted[0]);
+      std::copy(src.row(row), src.row(row) + nwords, s);
+      // the padding bits must be neutral
+      s[nwords - 1] = (s[nwords - 1] & last_mask) | (fill & ~last_mask);
+      // out(x) = op(in(x - anchor), ..., in(x - anchor + kw - 1))
+      //        = op(right(x), left(x)) with
+      // right(x) = op(in(x), ..., in(x + kw - anchor - 1))
+      // left(x)  = op(in(x - anchor), ..., in(x))
+      int anchor = kw / 2;
+      uint64_t* out = _tmp_bits.row(row);
+      std::copy(s, s + nwords, out);
+      accumulate_span<Op>(out, shifted, nwords, kw - anchor, true);
+      accumulate_span<Op>(s, shifted, nwords, anchor + 1, false);
+      for (int w = 0; w < nwords; ++w)
+        out[w] = Op::op(out[w], s[w]);
+      out[nwords - 1] &= last_mask;
+    } // end loop row
+    // vertical pass: _tmp_bits -> dst, on whole words
+    dst.create(src.rows, src.cols);
+    if (kh <= 1) {
+      dst.data = _tmp_bits.data;
+      return;
+    }
+    _src_rows64.resize(src.rows);
+    _dst_rows64.resize(src.rows);
+    for (int row = 0; row < src.rows; ++row) {
+      _src_rows64[row] = _tmp_bits.row(row);
+      _dst_rows64[row] = dst.row(row);
+    }
+    vhgw_columns<Op>(_src_rows64, _dst_rows64, nwords, kh, _g64, _h64, _neutral64);
+    for (int row = 0; row < src.rows; ++row)
+      dst.row(row)[nwords - 1] &= last_mask;
+  } // end filter2d_bits()
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  cv::Mat1b _tmp;
+  std::vector<uchar> _g8, _h8, _neutral8;
+  std::vector<const uchar*> _src_rows8;
+  std::vector<uchar*> _dst_rows8;
+  BitMask _tmp_bits;
+  std::vector<uint64_t> _s, _shifted, _g64, _h64, _neutral64;
+  std::vector<const uint64_t*> _src_rows64;
+  std::vector<uint64_t*> _dst_rows64;
+}; // end class MaskMorphology
+
+////////////////////////////////////////////////////////////////////////////////
+
+//! drop-in for cv::erode() with a kw x kh rectangle
+inline void erode_rect(const cv::Mat1b & src, cv::Mat1b & dst,
+                       const int kw, const int kh) {
+  MaskMorphology morph;
+  morph.erode_rect(src, dst, kw, kh);
+}
+
+//! drop-in for cv::dilate() with a kw x kh rectangle
+inline void dilate_rect(const cv::Mat1b & src, cv::Mat1b & dst,
+                        const int kw, const int kh) {
+  MaskMorphology morph;
+  morph.dilate_rect(src, dst, kw, kh);
+}
+
+//! drop-in for cv::morphologyEx(cv::MORPH_OPEN) with a kw x kh rectangle
+inline void open_rect(const cv::Mat1b & src, cv::Mat1b & dst,
+                      const int kw, const int kh) {
+  MaskMorphology morph;
+  morph.open_rect(src, dst, kw, kh);
+}
+
+//! drop-in for cv::morphologyEx(cv::MORPH_CLOSE) with a kw x kh rectangle
+inline void close_rect(const cv::Mat1b & src, cv::Mat1b & dst,
+                       const int kw, const int kh) {
+  MaskMorphology morph;
+  morph.close_rect(src, dst, kw, kh);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+//! \return the bounding box of the non null pixels of \a mask
+inline cv::Rect nonzero_bbox(const cv::Mat1b & mask) {
+  int xmin = mask.cols, xmax = -1, ymin = mask.rows, ymax = -1;
+  for (int row = 0; row < mask.rows; ++row) {
+    const uchar* data = mask.ptr<uchar>(row);
+    int first = 0, last = mask.cols - 1;
+    while (first < mask.cols && data[first] == 0)
+      ++first;
+    if (first == mask.cols)
+      continue;
+    while (data[last] == 0)
+      --last;
+    xmin = std::min(xmin, first);
+    xmax = std::max(xmax, last);
+    ymin = std::min(ymin, row);
+    ymax = row;
+  } // end loop row
+  if (xmax < 0)
+    return cv::Rect();
+  return cv::Rect(xmin, ymin, xmax - xmin + 1, ymax - ymin + 1);
+}
+
+} // end namespace image_utils
+
+#endif // MORPH_UTILS_H
@@ -437,6 +437,25 @@ public:
     out.transform.rotation.z = 0;
     out.transform.rotation.w = 1;
     _userjoint_data[user_id][joint_id_xn]= out;
+
+    // add the joint to the skeleton message of the user
+    // (the XnSkeletonJoint values are the NiteSkeletonJoint ones)
+    kinect::NiteSkeletonJoint joint;
+    joint.header = skeleton_list_msg.header;
+    joint.joint_id = joint_id_xn;
+    joint.child_frame_id = out.child_frame_id;
+    joint.pose3D.position.x = out.transform.translation.x;
+    joint.pose3D.position.y = out.transform.translation.y;
+    joint.pose3D.position.z = out.transform.translation.z;
+    joint.pose3D.orientation = out.transform.rotation;
+    // the image position, normalized in [0, 1]
+    XnPoint3D projective;
+    g_DepthGenerator.ConvertRealWorldToProjective(1, &joint_position.position, &projective);
+    joint.pose2D.x = projective.X / depth_output_mode.nXRes;
+    joint.pose2D.y = projective.Y / depth_output_mode.nYRes;
+    joint.pose2D.theta = 0;
+    joint.confidence = joint_position.fConfidence;
+    skeleton_list_msg.skeletons.back().joints.push_back(joint);
     return true;
   } // end get_userjoint_data_joint_transform();
 
@@ -448,6 +467,9 @@ public:
     XnUInt16 nusers = 15;
     g_UserGenerator.GetUsers(users, nusers);
     _userjoint_data.clear();
+    skeleton_list_msg.header.stamp = skeleton_clock.getTimeSeconds();
+    skeleton_list_msg.skeletons.clear();
+    g_DepthGenerator.GetMapOutputMode(depth_output_mode);
     std::string j_name;
     JointId j_id;
 
@@ -455,6 +477,9 @@ public:
       UserId curr_user_id = users[user_counter];
       if (!g_UserGenerator.GetSkeletonCap().IsTracking(curr_user_id))
         continue;
+      skeleton_list_msg.skeletons.push_back(kinect::NiteSkeleton());
+      skeleton_list_msg.skeletons.back().header = skeleton_list_msg.header;
+      skeleton_list_msg.skeletons.back().user_id = curr_user_id;
 
       add_userjoint_data(curr_user_id, XN_SKEL_HEAD);
       add_userjoint_data(curr_user_id, XN_SKEL_NECK);
@@ -537,6 +562,10 @@ private:
   bool publish_skeletons_flag;
   //! the message that will be filled with skeleton
   kinect::NiteSkeletonList skeleton_list_msg;
+  //! the time of skeleton_list_msg, in seconds
+  Timer skeleton_clock;
+  //! the depth resolution, to normalize the image position of the joints
+  XnMapOutputMode depth_output_mode;
   //! convert joint ID to string
   skeleton_utils::JointId2StringConverter joint_id_converter;
   //! the skeleton publisher
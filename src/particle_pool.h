@@ -0,0 +1,251 @@
+/*!
+  \file        particle_pool.h
+  \author      Arnaud Ramey <arnaud.a.ramey@gmail.com>
+                -- Robotics Lab, University Carlos III of Madrid
+  \date        2013/10/20
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+
+\class ParticlePool
+\brief A fixed-capacity set of particles falling under gravity,
+stored as a structure of arrays.
+
+Each attribute (x, y, speed, mass, color, birth) is a contiguous array,
+allocated once: the integration is a few loops over floats,
+vectorized with SSE when available.
+A dead particle is replaced by the last one (swap-remove), in O(1):
+the live particles are always [0, size()), in no particular order.
+
+The number of particles is bounded by a budget: when it is reached,
+the oldest particles are evicted, by batches of BUDGET_EVICTION_DIVIDER-th
+of the budget, found with a partial sort in O(size()).
+
+The particles can bounce on a mask thanks to its \a DistanceField,
+with one lookup per particle.
+
+ */
+
+#ifndef PARTICLE_POOL_H
+#define PARTICLE_POOL_H
+
+#include <opencv2/core/core.hpp>
+#include <vector>
+#include <algorithm>
+#include "distance_field.h"
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif // __SSE__
+
+class ParticlePool {
+public:
+  //! when the budget is reached, evict 1/BUDGET_EVICTION_DIVIDER of it
+  static const unsigned int BUDGET_EVICTION_DIVIDER = 8;
+
+  /*!
+   * \param capacity
+   *    the max budget, allocated once
+   * \param gravity
+   *    the acceleration of a particle of mass 1, in pixels/s^2, downwards
+   */
+  ParticlePool(const unsigned int capacity = 20000, const float gravity = 9.81f)
+    : _capacity(capacity), _budget(capacity), _gravity(gravity) {
+    _x.resize(capacity);
+    _y.resize(capacity);
+    _vx.resize(capacity);
+    _vy.resize(capacity);
+    _mass.resize(capacity);
+    _color.resize(capacity);
+    _birth.resize(capacity);
+    clear();
+  }
+
+  inline void clear() {
+    _size = 0;
+    _next_birth = 0;
+  }
+
+  inline unsigned int size() const { return _size; }
+  inline unsigned int capacity() const { return _capacity; }
+  inline unsigned int budget() const { return _budget; }
+
+  //! set the max number of particles, at most capacity()
+  inline void set_budget(const unsigned int budget) {
+    _budget = std::max(1u, std::min(budget, _capacity));
+    if (_size > _budget)
+      evict_oldest(_size - _budget);
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! add a particle, evicting the oldest ones if the budget is reached
+  inline void add(const cv::Point2f & position, const cv::Point2f & speed,
+                  const float mass, const cv::Vec3b & color) {
+    if (_size >= _budget)
+      evict_oldest(std::max(1u, _budget / BUDGET_EVICTION_DIVIDER));
+    unsigned int i = _size++;
+    _x[i] = position.x;
+    _y[i] = position.y;
+    _vx[i] = speed.x;
+    _vy[i] = speed.y;
+    _mass[i] = mass;
+    _color[i] = color;
+    _birth[i] = _next_birth++;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * Integrate the particles [begin, end) during \a dt_sec.
+   * Different ranges can be integrated concurrently.
+   */
+  void integrate(const float dt_sec, const unsigned int begin, const unsigned int end) {
+    float* x = &(_x[0]), *y = &(_y[0]), *vx = &(_vx[0]), *vy = &(_vy[0]);
+    const float* mass = &(_mass[0]);
+    float g_dt = _gravity * dt_sec;
+    unsigned int i = begin;
+#ifdef __SSE__
+    __m128 dt4 = _mm_set1_ps(dt_sec), g_dt4 = _mm_set1_ps(g_dt);
+    for (; i + 4 <= end; i += 4) {
+      __m128 vx4 = _mm_loadu_ps(vx + i);
+      __m128 vy4 = _mm_add_ps(_mm_loadu_ps(vy + i),
+                              _mm_mul_ps(g_dt4, _mm_loadu_ps(mass + i)));
+      _mm_storeu_ps(vy + i, vy4);
+      _mm_storeu_ps(x + i, _mm_add_ps(_mm_loadu_ps(x + i), _mm_mul_ps(dt4, vx4)));
+      _mm_storeu_ps(y + i, _mm_add_ps(_mm_loadu_ps(y + i), _mm_mul_ps(dt4, vy4)));
+    } // end loop i
+#endif // __SSE__
+    for (; i < end; ++i) {
+      vy[i] += g_dt * mass[i];
+      x[i] += dt_sec * vx[i];
+      y[i] += dt_sec * vy[i];
+    } // end loop i
+  } // end integrate();
+
+  //! integrate all the particles
+  inline void integrate(const float dt_sec) { integrate(dt_sec, 0, _size); }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * Make the particles [begin, end) that are in \a field (closer than
+   * \a radius to it) bounce on it.
+   * \param restitution
+   *    the part of the normal speed that is given back, in [0, 1]
+   * \param friction
+   *    the part of the tangential speed that is lost, in [0, 1].
+   *    With friction, particles can rest on the mask.
+   */
+  void collide(const DistanceField & field, const float radius,
+               const float restitution, const float friction,
+               const unsigned int begin, const unsigned int end) {
+    if (!field.valid())
+      return;
+    float dist, nx, ny;
+    for (unsigned int i = begin; i < end; ++i) {
+      field.sample(_x[i], _y[i], dist, nx, ny);
+      float penetration = radius - dist;
+      if (penetration <= 0)
+        continue;
+      // move out of the mask
+      _x[i] += penetration * nx;
+      _y[i] += penetration * ny;
+      // split the speed into normal and tangential parts
+      float vn = _vx[i] * nx + _vy[i] * ny;
+      if (vn >= 0) // already going out
+        continue;
+      float vtx = _vx[i] - vn * nx, vty = _vy[i] - vn * ny;
+      _vx[i] = (1 - friction) * vtx - restitution * vn * nx;
+      _vy[i] = (1 - friction) * vty - restitution * vn * ny;
+    } // end loop i
+  } // end collide();
+
+  //! collide all the particles
+  inline void collide(const DistanceField & field, const float radius,
+                      const float restitution, const float friction) {
+    collide(field, radius, restitution, friction, 0, _size);
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! remove the particles out of [xmin, xmax] or below ymax, in O(size())
+  void kill_out_of(const float xmin, const float xmax, const float ymax) {
+    unsigned int i = 0;
+    while (i < _size) {
+      if (_x[i] < xmin || _x[i] > xmax || _y[i] > ymax)
+        swap_remove(i);
+      else
+        ++i;
+    } // end while (i < _size)
+  } // end kill_out_of();
+
+  //! remove the \a nb oldest particles
+  void evict_oldest(const unsigned int nb) {
+    if (nb >= _size) {
+      _size = 0;
+      return;
+    }
+    if (nb == 0)
+      return;
+    // the births are unique: the nb oldest are those <= the nb-th smallest
+    _births_buffer.assign(_birth.begin(), _birth.begin() + _size);
+    std::nth_element(_births_buffer.begin(), _births_buffer.begin() + nb - 1,
+                     _births_buffer.end());
+    unsigned int threshold = _births_buffer[nb - 1];
+    unsigned int i = 0;
+    while (i < _size) {
+      if (_birth[i] <= threshold)
+        swap_remove(i);
+      else
+        ++i;
+    } // end while (i < _size)
+  } // end evict_oldest();
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  inline const float* x() const { return &(_x[0]); }
+  inline const float* y() const { return &(_y[0]); }
+  inline const float* vx() const { return &(_vx[0]); }
+  inline const float* vy() const { return &(_vy[0]); }
+  inline const float* mass() const { return &(_mass[0]); }
+  inline const cv::Vec3b* color() const { return &(_color[0]); }
+
+private:
+  //! replace particle i by the last one
+  inline void swap_remove(const unsigned int i) {
+    unsigned int last = --_size;
+    _x[i] = _x[last];
+    _y[i] = _y[last];
+    _vx[i] = _vx[last];
+    _vy[i] = _vy[last];
+    _mass[i] = _mass[last];
+    _color[i] = _color[last];
+    _birth[i] = _birth[last];
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  unsigned int _capacity, _budget, _size;
+  float _gravity;
+  std::vector<float> _x, _y, _vx, _vy, _mass;
+  std::vector<cv::Vec3b> _color;
+  //! the creation order of each particle, for the eviction
+  std::vector<unsigned int> _birth;
+  unsigned int _next_birth;
+  std::vector<unsigned int> _births_buffer;
+}; // end class ParticlePool
+
+#endif // PARTICLE_POOL_H
@@ -0,0 +1,247 @@
+/*!
+  \file        particle_renderer.h
+  \author      Arnaud Ramey <arnaud.a.ramey@gmail.com>
+                -- Robotics Lab, University Carlos III of Madrid
+  \date        2013/10/20
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+
+\class ParticleRenderer
+\brief Integrates and draws the particles of a \a ParticlePool
+on several threads.
+
+The integration is split in chunks of particles.
+The drawing splats, for each particle, a pre-rendered anti-aliased disc
+of its radius (one sprite per integer radius),
+added to the image with its color.
+The image is cut in horizontal bands: the particles are first binned
+by the bands they cover, then each band is splatted
+into its rows of a 16 bits accumulator, and added to the image,
+independently of the other bands.
+No two threads write the same pixel, so there is no lock and no merge pass,
+and the result does not depend on the number of threads.
+
+ */
+
+#ifndef PARTICLE_RENDERER_H
+#define PARTICLE_RENDERER_H
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/core/version.hpp>
+#include <vector>
+#include <math.h>
+#include "particle_pool.h"
+
+#if (CV_MAJOR_VERSION > 2) || (CV_MAJOR_VERSION == 2 && CV_MINOR_VERSION > 3)
+#define PARTICLE_RENDERER_PARALLEL
+#endif
+
+class ParticleRenderer {
+public:
+  //! the number of particles integrated by a thread at once
+  static const unsigned int INTEGRATION_CHUNK = 4096;
+  //! the height of the bands of the image, in pixels
+  static const int BAND_HEIGHT = 16;
+  //! the biggest radius with a sprite, bigger particles are clamped
+  static const int MAX_SPRITE_RADIUS = 16;
+
+  ParticleRenderer() {
+    // one anti-aliased disc per radius
+    _sprites.resize(MAX_SPRITE_RADIUS + 1);
+    for (int radius = 0; radius <= MAX_SPRITE_RADIUS; ++radius) {
+      cv::Mat1b & sprite = _sprites[radius];
+      sprite.create(2 * radius + 1, 2 * radius + 1);
+      for (int row = 0; row < sprite.rows; ++row) {
+        for (int col = 0; col < sprite.cols; ++col) {
+          // the coverage of the pixel, from the distance of its center
+          double dist = hypot(row - radius, col - radius);
+          double coverage = std::max(0., std::min(1., radius + .5 - dist));
+          sprite(row, col) = cv::saturate_cast<uchar>(255 * coverage);
+        } // end loop col
+      } // end loop row
+    } // end loop radius
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! integrate all the particles of \a pool, by chunks on several threads
+  void integrate(ParticlePool & pool, const float dt_sec) const {
+    unsigned int nchunks = (pool.size() + INTEGRATION_CHUNK - 1) / INTEGRATION_CHUNK;
+#ifdef PARTICLE_RENDERER_PARALLEL
+    if (nchunks > 1) {
+      cv::parallel_for_(cv::Range(0, nchunks), ChunkIntegrator(pool, dt_sec));
+      return;
+    }
+#endif // PARTICLE_RENDERER_PARALLEL
+    if (nchunks > 0)
+      pool.integrate(dt_sec);
+  } // end integrate();
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * Add the particles of \a pool to \a img_out.
+   * \param radius_offset, radius_per_mass
+   *    the radius of a particle is radius_offset + radius_per_mass * mass
+   */
+  void render(const ParticlePool & pool, cv::Mat3b & img_out,
+              const float radius_offset = 2, const float radius_per_mass = .1f) {
+    if (img_out.empty())
+      return;
+    int nbands = (img_out.rows + BAND_HEIGHT - 1) / BAND_HEIGHT;
+    bin_particles(pool, img_out.size(), nbands, radius_offset, radius_per_mass);
+    _accum.create(img_out.size());
+    BandSplatter splatter(*this, pool, img_out);
+#ifdef PARTICLE_RENDERER_PARALLEL
+    cv::parallel_for_(cv::Range(0, nbands), splatter);
+#else
+    splatter(cv::Range(0, nbands));
+#endif // PARTICLE_RENDERER_PARALLEL
+  } // end render();
+
+private:
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! list the particles of each band, in _band_particles
+  void bin_particles(const ParticlePool & pool, const cv::Size & img_size,
+                     const int nbands,
+                     const float radius_offset, const float radius_per_mass) {
+    unsigned int npart = pool.size();
+    const float* x = pool.x(), *y = pool.y(), *mass = pool.mass();
+    _radius.resize(npart);
+    _band_begin.assign(nbands + 1, 0);
+    // count, then fill the lists of the bands
+    for (int pass = 0; pass < 2; ++pass) {
+      if (pass == 1) {
+        for (int band = 0; band < nbands; ++band)
+          _band_begin[band + 1] += _band_begin[band];
+        _band_particles.resize(_band_begin.back());
+        _fill.assign(_band_begin.begin(), _band_begin.end() - 1);
+      }
+      for (unsigned int part_idx = 0; part_idx < npart; ++part_idx) {
+        if (pass == 0)
+          _radius[part_idx] = std::max(0, std::min((int) MAX_SPRITE_RADIUS,
+              cvRound(radius_offset + radius_per_mass * mass[part_idx])));
+        int r = _radius[part_idx];
+        int col = cvRound(x[part_idx]), row = cvRound(y[part_idx]);
+        if (col + r < 0 || col - r >= img_size.width
+            || row + r < 0 || row - r >= img_size.height)
+          continue;
+        int band_min = std::max(0, row - r) / BAND_HEIGHT;
+        int band_max = std::min(img_size.height - 1, row + r) / BAND_HEIGHT;
+        for (int band = band_min; band <= band_max; ++band) {
+          if (pass == 0)
+            ++_band_begin[band + 1];
+          else
+            _band_particles[_fill[band]++] = part_idx;
+        } // end loop band
+      } // end loop part_idx
+    } // end loop pass
+  } // end bin_particles();
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! splat the particles of the bands of \a range, then add them to the image
+  void splat_bands(const ParticlePool & pool, cv::Mat3b & img_out,
+                   const cv::Range & range) {
+    const float* x = pool.x(), *y = pool.y();
+    const cv::Vec3b* color = pool.color();
+    for (int band = range.start; band < range.end; ++band) {
+      int row_begin = band * BAND_HEIGHT;
+      int row_end = std::min(img_out.rows, row_begin + BAND_HEIGHT);
+      _accum.rowRange(row_begin, row_end).setTo(0);
+      for (int i = _band_begin[band]; i < _band_begin[band + 1]; ++i) {
+        unsigned int part_idx = _band_particles[i];
+        int r = _radius[part_idx];
+        const cv::Mat1b & sprite = _sprites[r];
+        int col0 = cvRound(x[part_idx]) - r, row0 = cvRound(y[part_idx]) - r;
+        int cmin = std::max(0, col0), cmax = std::min(img_out.cols, col0 + sprite.cols);
+        int rmin = std::max(row_begin, row0), rmax = std::min(row_end, row0 + sprite.rows);
+        const cv::Vec3b & c = color[part_idx];
+        for (int row = rmin; row < rmax; ++row) {
+          const uchar* sprite_data = sprite.ptr<uchar>(row - row0);
+          unsigned short* accum_data = _accum.ptr<unsigned short>(row);
+          for (int col = cmin; col < cmax; ++col) {
+            unsigned int w = sprite_data[col - col0];
+            unsigned short* a = accum_data + 3 * col;
+            for (int chan = 0; chan < 3; ++chan)
+              a[chan] = std::min(65535u, a[chan] + ((c[chan] * w) >> 8));
+          } // end loop col
+        } // end loop row
+      } // end loop i
+      // add the band to the image
+      for (int row = row_begin; row < row_end; ++row) {
+        const unsigned short* accum_data = _accum.ptr<unsigned short>(row);
+        uchar* out_data = img_out.ptr<uchar>(row);
+        for (int i = 0; i < 3 * img_out.cols; ++i)
+          out_data[i] = std::min(255, out_data[i] + accum_data[i]);
+      } // end loop row
+    } // end loop band
+  } // end splat_bands();
+
+  //////////////////////////////////////////////////////////////////////////////
+
+#ifdef PARTICLE_RENDERER_PARALLEL
+  class ChunkIntegrator : public cv::ParallelLoopBody {
+#else
+  class ChunkIntegrator {
+#endif // PARTICLE_RENDERER_PARALLEL
+  public:
+    ChunkIntegrator(ParticlePool & pool, const float dt_sec)
+      : _pool(pool), _dt_sec(dt_sec) {}
+    void operator()(const cv::Range & range) const {
+      unsigned int begin = range.start * INTEGRATION_CHUNK;
+      unsigned int end = std::min(_pool.size(), range.end * INTEGRATION_CHUNK);
+      _pool.integrate(_dt_sec, begin, end);
+    }
+  private:
+    ParticlePool & _pool;
+    float _dt_sec;
+  }; // end class ChunkIntegrator
+
+#ifdef PARTICLE_RENDERER_PARALLEL
+  class BandSplatter : public cv::ParallelLoopBody {
+#else
+  class BandSplatter {
+#endif // PARTICLE_RENDERER_PARALLEL
+  public:
+    BandSplatter(ParticleRenderer & renderer, const ParticlePool & pool,
+                 cv::Mat3b & img_out)
+      : _renderer(renderer), _pool(pool), _img_out(img_out) {}
+    void operator()(const cv::Range & range) const {
+      _renderer.splat_bands(_pool, _img_out, range);
+    }
+  private:
+    ParticleRenderer & _renderer;
+    const ParticlePool & _pool;
+    cv::Mat3b & _img_out;
+  }; // end class BandSplatter
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! the sprite of each radius: the coverage of each pixel, in [0, 255]
+  std::vector<cv::Mat1b> _sprites;
+  //! the rows of each band are written by a single thread
+  cv::Mat3w _accum;
+  //! the radius of each particle
+  std::vector<int> _radius;
+  //! the particles of band i are _band_particles[_band_begin[i] .. _band_begin[i+1]-1]
+  std::vector<int> _band_begin, _fill;
+  std::vector<unsigned int> _band_particles;
+}; // end class ParticleRenderer
+
+#endif // PARTICLE_RENDERER_H
@@ -0,0 +1,244 @@
+/*!
+  \file        rgbd_sequence.h
+  \author      Arnaud Ramey <arnaud.a.ramey@gmail.com>
+                -- Robotics Lab, University Carlos III of Madrid
+  \date        2013/10/20
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+
+Recording and replay of sequences of color, depth and user images,
+as PNG files in a folder:
+  - color_00000.png: the BGR image
+  - depth_00000.png: the depth, 16 bits, in millimeters
+  - user_00000.png: the user map of NITE
+  - gt_00000.png (optional): a hand-labelled user map
+The files are written in a background thread.
+
+ */
+
+#ifndef RGBD_SEQUENCE_H
+#define RGBD_SEQUENCE_H
+
+#include <opencv2/highgui/highgui.hpp>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <boost/thread.hpp>
+#include "std_utils.h"
+#include "debug.h"
+
+namespace rgbd_sequence {
+
+//! \return for instance "folder/color_00012.png"
+inline std::string filename(const std::string & folder,
+                            const std::string & prefix,
+                            const int frame_idx) {
+  char buffer[32];
+  sprintf(buffer, "_%05i.png", frame_idx);
+  return folder + "/" + prefix + buffer;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*!
+ * Writes the frames in a background thread, so that the PNG compression
+ * does not slow down the caller.
+ * write() only copies the frame into a ring of QUEUE_SIZE slots.
+ * If the writing thread is late and the ring is full, the frame is dropped.
+ */
+class Writer {
+public:
+  //! the number of frames that can wait to be written
+  static const unsigned int QUEUE_SIZE = 16;
+
+  Writer() : _frame_idx(0), _nb_dropped(0), _open(false), _failed(false),
+    _head(0), _count(0), _stop(false) {
+    _queue.resize(QUEUE_SIZE);
+  }
+
+  ~Writer() { close(); }
+
+  //! create \a folder if needed and start writing at frame 0
+  bool open(const std::string & folder) {
+    close();
+    if (std_utils::exec_system("mkdir -p " + folder) != 0) {
+      maggiePrint("Impossible to create folder '%s'", folder.c_str());
+      return false;
+    }
+    _folder = folder;
+    _frame_idx = _nb_dropped = 0;
+    _head = _count = 0;
+    _stop = _failed = false;
+    _open = true;
+    _thread = boost::thread(&Writer::consume, this);
+    return true;
+  }
+
+  //! write the frames still queued, then stop the writing thread
+  void close() {
+    if (!_open)
+      return;
+    {
+      boost::mutex::scoped_lock lock(_mutex);
+      _stop = true;
+    }
+    _not_empty.notify_all();
+    _thread.join();
+    _open = false;
+    if (_nb_dropped > 0)
+      maggiePrint("Recording '%s': %i frames dropped, the disk was too slow",
+                  _folder.c_str(), _nb_dropped);
+  }
+
+  inline bool is_open() const { return _open; }
+  //! the number of frames written since open(), final after close()
+  inline int nframes() const { return _frame_idx; }
+  inline const std::string & folder() const { return _folder; }
+
+  /*!
+   * Queue a frame, without waiting.
+   * \param depth in meters
+   * \return false if the frame was dropped, or if a write failed
+   */
+  bool write(const cv::Mat3b & color, const cv::Mat1f & depth,
+             const cv::Mat1b & user) {
+    if (!_open)
+      return false;
+    unsigned int slot;
+    {
+      boost::mutex::scoped_lock lock(_mutex);
+      if (_failed) {
+        maggiePrint("Could not write frame %i in '%s', stopping the recording",
+                    _frame_idx, _folder.c_str());
+        lock.unlock();
+        close();
+        return false;
+      }
+      if (_count == _queue.size()) {
+        ++_nb_dropped;
+        return false;
+      }
+      slot = (_head + _count) % _queue.size();
+    }
+    // the slot is not read by the writing thread until _count is increased
+    Frame & frame = _queue[slot];
+    color.copyTo(frame.color);
+    depth.convertTo(frame.depth16, CV_16U, 1000);
+    user.copyTo(frame.user);
+    {
+      boost::mutex::scoped_lock lock(_mutex);
+      ++_count;
+    }
+    _not_empty.notify_one();
+    return true;
+  }
+
+private:
+  struct Frame {
+    cv::Mat3b color;
+    cv::Mat1w depth16;
+    cv::Mat1b user;
+  };
+
+  //! the writing thread
+  void consume() {
+    while (true) {
+      {
+        boost::mutex::scoped_lock lock(_mutex);
+        while (!_stop && _count == 0)
+          _not_empty.wait(lock);
+        if (_count == 0) // stopped and everything written
+          return;
+      }
+      // the head slot is not written by write() until _count is decreased
+      const Frame & frame = _queue[_head];
+      bool ok = cv::imwrite(filename(_folder, "color", _frame_idx), frame.color)
+          && cv::imwrite(filename(_folder, "depth", _frame_idx), frame.depth16)
+          && cv::imwrite(filename(_folder, "user", _frame_idx), frame.user);
+      boost::mutex::scoped_lock lock(_mutex);
+      if (!ok) {
+        _failed = true;
+        return;
+      }
+      ++_frame_idx;
+      _head = (_head + 1) % _queue.size();
+      --_count;
+    } // end while (true)
+  }
+
+  std::string _folder;
+  int _frame_idx, _nb_dropped;
+  bool _open, _failed;
+  //! the frames to write, from _head to _head + _count - 1
+  std::vector<Frame> _queue;
+  unsigned int _head, _count;
+  boost::thread _thread;
+  boost::mutex _mutex;
+  boost::condition_variable _not_empty;
+  bool _stop;
+}; // end class Writer
+
+////////////////////////////////////////////////////////////////////////////////
+
+class Reader {
+public:
+  Reader() : _frame_idx(0) {}
+
+  //! start reading \a folder at frame 0
+  inline void open(const std::string & folder) {
+    _folder = folder;
+    _frame_idx = 0;
+  }
+
+  /*!
+   * Read the next frame.
+   * \param depth in meters
+   * \param gt
+   *    the hand-labelled user map, empty if there is none for this frame
+   * \return false at the end of the sequence
+   */
+  bool read(cv::Mat3b & color, cv::Mat1f & depth, cv::Mat1b & user,
+            cv::Mat1b & gt) {
+    color = cv::imread(filename(_folder, "color", _frame_idx), CV_LOAD_IMAGE_COLOR);
+    if (color.empty())
+      return false;
+    _depth16 = cv::imread(filename(_folder, "depth", _frame_idx),
+                          CV_LOAD_IMAGE_ANYDEPTH);
+    user = cv::imread(filename(_folder, "user", _frame_idx),
+                      CV_LOAD_IMAGE_GRAYSCALE);
+    if (_depth16.empty() || user.empty()) {
+      maggiePrint("Incomplete frame %i in '%s'", _frame_idx, _folder.c_str());
+      return false;
+    }
+    _depth16.convertTo(depth, CV_32F, 1. / 1000);
+    gt = cv::imread(filename(_folder, "gt", _frame_idx), CV_LOAD_IMAGE_GRAYSCALE);
+    ++_frame_idx;
+    return true;
+  }
+
+  //! the index of the last frame read
+  inline int frame_idx() const { return _frame_idx - 1; }
+
+private:
+  std::string _folder;
+  int _frame_idx;
+  cv::Mat1w _depth16;
+}; // end class Reader
+
+} // end namespace rgbd_sequence
+
+#endif // RGBD_SEQUENCE_H
@@ -0,0 +1,229 @@
+/*!
+  \file        segment_grid.h
+  \author      Arnaud Ramey <arnaud.a.ramey@gmail.com>
+                -- Robotics Lab, University Carlos III of Madrid
+  \date        2013/10/20
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+
+\class SegmentGrid
+\brief A uniform grid over the segments of a polyline,
+for nearest segment queries.
+
+Each segment is listed in all the cells its bounding box covers,
+the lists being stored contiguously (one offset per cell).
+A query visits the rings of cells around the query point,
+and stops as soon as no unvisited cell can be closer than the best segment:
+with cells of the size of the segments, a query visits a few cells.
+
+The points can be grouped, for instance by contour:
+consecutive points of different groups are not linked.
+The segments can be labelled, for instance with their user,
+and a query can be restricted to a label.
+By default, the label of a segment is its group.
+
+ */
+
+#ifndef SEGMENT_GRID_H
+#define SEGMENT_GRID_H
+
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include "distances.h"
+
+namespace geometry_utils {
+
+template<class Point2>
+class SegmentGrid {
+public:
+  //! the label that matches all the labels in query()
+  static const int ANY_LABEL = -1;
+
+  /*!
+   * \param cell_size
+   *    the size of a cell, in the unit of the points.
+   *    Should be about the length of the segments.
+   */
+  SegmentGrid(const double cell_size = 16) : _cell_size(cell_size) {}
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * Index the segments [pts[i], pts[i+1]].
+   * \param is_closed
+   *    if true, also index [pts.back(), pts.front()]
+   * \param groups
+   *    if not NULL, the group of each point.
+   *    Two consecutive points are linked only if they have the same group.
+   * \param labels
+   *    if not NULL, the label of each point, used by query().
+   *    A segment has the label of its first point.
+   *    If NULL, the labels are the groups.
+   */
+  void build(const std::vector<Point2> & pts, const bool is_closed = false,
+             const std::vector<int>* groups = NULL,
+             const std::vector<int>* labels = NULL) {
+    if (!labels)
+      labels = groups;
+    _pts = pts;
+    _seg_a.clear();
+    _seg_b.clear();
+    _labels.clear();
+    _cell_begin.clear();
+    _cell_segments.clear();
+    if (pts.empty())
+      return;
+    int npts = pts.size();
+    for (int i = 0; i < npts; ++i) {
+      int label = (labels ? (*labels)[i] : 0);
+      int group = (groups ? (*groups)[i] : 0);
+      int next = (i + 1 < npts ? i + 1 : (is_closed ? 0 : -1));
+      bool linked_next = (next >= 0 && next != i
+                          && (!groups || (*groups)[next] == group));
+      if (linked_next)
+        add_segment(i, next, label);
+      // a point linked to nothing is a degenerate segment
+      int prev = (i > 0 ? i - 1 : (is_closed ? npts - 1 : -1));
+      bool linked_prev = (prev >= 0 && prev != i
+                          && (!groups || (*groups)[prev] == group));
+      if (!linked_next && !linked_prev)
+        add_segment(i, i, label);
+    } // end loop i
+
+    // the grid
+    double xmin = pts[0].x, xmax = xmin, ymin = pts[0].y, ymax = ymin;
+    for (int i = 1; i < npts; ++i) {
+      xmin = std::min(xmin, (double) pts[i].x);
+      xmax = std::max(xmax, (double) pts[i].x);
+      ymin = std::min(ymin, (double) pts[i].y);
+      ymax = std::max(ymax, (double) pts[i].y);
+    } // end loop i
+    _x0 = xmin;
+    _y0 = ymin;
+    _cols = 1 + (int) ((xmax - xmin) / _cell_size);
+    _rows = 1 + (int) ((ymax - ymin) / _cell_size);
+
+    // count, then fill the lists of the cells
+    _cell_begin.assign(_cols * _rows + 1, 0);
+    for (int pass = 0; pass < 2; ++pass) {
+      if (pass == 1) {
+        for (int cell = 0; cell < _cols * _rows; ++cell)
+          _cell_begin[cell + 1] += _cell_begin[cell];
+        _cell_segments.resize(_cell_begin.back());
+        _fill.assign(_cell_begin.begin(), _cell_begin.end() - 1);
+      }
+      for (unsigned int seg = 0; seg < _seg_a.size(); ++seg) {
+        const Point2 & a = seg_begin(seg), & b = seg_end(seg);
+        int cmin = cell_col(std::min(a.x, b.x)), cmax = cell_col(std::max(a.x, b.x));
+        int rmin = cell_row(std::min(a.y, b.y)), rmax = cell_row(std::max(a.y, b.y));
+        for (int row = rmin; row <= rmax; ++row) {
+          for (int col = cmin; col <= cmax; ++col) {
+            int cell = row * _cols + col;
+            if (pass == 0)
+              ++_cell_begin[cell + 1];
+            else
+              _cell_segments[_fill[cell]++] = seg;
+          } // end loop col
+        } // end loop row
+      } // end loop seg
+    } // end loop pass
+  } // end build();
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * Find the closest point of the indexed segments.
+   * \param label
+   *    only consider the segments of this label, or ANY_LABEL
+   * \return false if there is no segment (of this label)
+   */
+  bool query(const Point2 & pt, Point2 & closest_pt, double & closest_dist_sq,
+             const int label = ANY_LABEL) const {
+    closest_dist_sq = std::numeric_limits<double>::max();
+    if (_seg_a.empty())
+      return false;
+    int c0 = std::max(0, std::min(_cols - 1, cell_col(pt.x)));
+    int r0 = std::max(0, std::min(_rows - 1, cell_row(pt.y)));
+    int max_ring = std::max(std::max(c0, _cols - 1 - c0), std::max(r0, _rows - 1 - r0));
+    Point2 proj;
+    for (int ring = 0; ring <= max_ring; ++ring) {
+      for (int row = r0 - ring; row <= r0 + ring; ++row) {
+        if (row < 0 || row >= _rows)
+          continue;
+        bool full_row = (row == r0 - ring || row == r0 + ring);
+        for (int col = c0 - ring; col <= c0 + ring;
+             col += (full_row || ring == 0 ? 1 : 2 * ring)) {
+          if (col < 0 || col >= _cols)
+            continue;
+          int cell = row * _cols + col;
+          for (int i = _cell_begin[cell]; i < _cell_begin[cell + 1]; ++i) {
+            int seg = _cell_segments[i];
+            if (label != ANY_LABEL && _labels[seg] != label)
+              continue;
+            const Point2 & a = seg_begin(seg), & b = seg_end(seg);
+            double dist_sq;
+            if (a.x == b.x && a.y == b.y) {
+              proj = a;
+              dist_sq = distance_points_squared(pt, a);
+            }
+            else
+              dist_sq = distance_point_segment_sq(pt, a, b, proj);
+            if (dist_sq < closest_dist_sq) {
+              closest_dist_sq = dist_sq;
+              closest_pt = proj;
+            }
+          } // end loop i
+        } // end loop col
+      } // end loop row
+      // the cells of the next rings are at least ring * _cell_size away
+      double bound = ring * _cell_size;
+      if (closest_dist_sq <= bound * bound)
+        break;
+    } // end loop ring
+    return closest_dist_sq < std::numeric_limits<double>::max();
+  } // end query();
+
+private:
+  //////////////////////////////////////////////////////////////////////////////
+
+  inline int cell_col(const double x) const { return (int) floor((x - _x0) / _cell_size); }
+  inline int cell_row(const double y) const { return (int) floor((y - _y0) / _cell_size); }
+
+  inline void add_segment(const int a, const int b, const int label) {
+    _seg_a.push_back(a);
+    _seg_b.push_back(b);
+    _labels.push_back(label);
+  }
+  inline const Point2 & seg_begin(const int seg) const { return _pts[_seg_a[seg]]; }
+  inline const Point2 & seg_end(const int seg) const { return _pts[_seg_b[seg]]; }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  double _cell_size;
+  std::vector<Point2> _pts;
+  //! the indices in _pts of the ends of each segment, and its label
+  std::vector<int> _seg_a, _seg_b, _labels;
+  double _x0, _y0;
+  int _cols, _rows;
+  //! the segments of cell i are _cell_segments[_cell_begin[i] .. _cell_begin[i+1]-1]
+  std::vector<int> _cell_begin, _cell_segments, _fill;
+}; // end class SegmentGrid
+
+} // end namespace geometry_utils
+
+#endif // SEGMENT_GRID_H
@@ -0,0 +1,206 @@
+/*!
+  \file        user_crop_history.h
+  \author      Arnaud Ramey <arnaud.a.ramey@gmail.com>
+                -- Robotics Lab, University Carlos III of Madrid
+  \date        2013/10/20
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+
+\class UserCropHistory
+\brief The recent past of the users: for each frame, the crop of the users
+bounding box, with color, user labels and depth.
+
+The crops are stored in a single arena, allocated once,
+used as a circular buffer: a new crop is written after the previous one,
+or at the start of the arena if it does not fit at the end,
+and evicts the oldest crops it overlaps.
+Memory is thus bounded by the arena size, and there is no allocation
+per frame.
+Each crop takes 6 bytes per pixel (BGR, label, depth in millimeters):
+for 3 seconds at 30 fps, a 200x400 crop needs 43 MB.
+
+ */
+
+#ifndef USER_CROP_HISTORY_H
+#define USER_CROP_HISTORY_H
+
+#include <opencv2/core/core.hpp>
+#include <vector>
+#include <limits>
+#include "std_utils.h"
+#include "nan_handling.h"
+
+class UserCropHistory {
+public:
+  //! the stored depth of the pixels with no depth: far, but finite
+  static const unsigned short NO_DEPTH = 65535;
+
+  struct Entry {
+    //! the time of the frame, in seconds
+    double timestamp;
+    //! the crop in the frame
+    cv::Rect roi;
+    //! the position of the crop in the arena, and its size
+    size_t offset, bytes;
+  };
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * \param max_entries
+   *    the max number of frames
+   * \param arena_bytes
+   *    the size of the arena, bounds the memory used
+   */
+  UserCropHistory(const unsigned int max_entries = 90,
+                  const size_t arena_bytes = 96 * 1024 * 1024)
+    : _arena_bytes(arena_bytes) {
+    _entries.resize(max_entries);
+    clear();
+  }
+
+  //! forget all crops, keeping the memory
+  inline void clear() {
+    _head = _count = 0;
+    _write_offset = 0;
+  }
+
+  inline unsigned int size() const { return _count; }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * Store the crop \a roi of a frame.
+   * \param depth
+   *    in meters, can be empty
+   * \return false if the crop is empty or bigger than the arena
+   */
+  bool push(const double timestamp, const cv::Rect & roi,
+            const cv::Mat3b & color, const cv::Mat1b & user,
+            const cv::Mat1f & depth) {
+    size_t area = roi.width * roi.height;
+    // 16 bytes aligned
+    size_t bytes = (6 * area + 15) & ~((size_t) 15);
+    if (area == 0 || bytes > _arena_bytes || _entries.empty())
+      return false;
+    if (_arena.size() != _arena_bytes)
+      _arena.resize(_arena_bytes); // only once
+
+    // find room
+    size_t pos = _write_offset;
+    if (pos + bytes > _arena_bytes) {
+      // the crops after pos are the oldest ones: evict them and wrap
+      while (_count > 0 && oldest().offset >= pos)
+        pop_oldest();
+      pos = 0;
+    }
+    while (_count > 0 && (_count == _entries.size() || overlaps(oldest(), pos, bytes)))
+      pop_oldest();
+
+    // copy the crop
+    Entry & entry = _entries[(_head + _count) % _entries.size()];
+    entry.timestamp = timestamp;
+    entry.roi = roi;
+    entry.offset = pos;
+    entry.bytes = bytes;
+    ++_count;
+    _write_offset = pos + bytes;
+    cv::Mat3b color_crop;
+    cv::Mat1b user_crop;
+    cv::Mat1w depth_crop;
+    get_mats(entry, color_crop, user_crop, depth_crop);
+    color(roi).copyTo(color_crop);
+    user(roi).copyTo(user_crop);
+    bool has_depth = (depth.size() == user.size());
+    for (int row = 0; row < roi.height; ++row) {
+      unsigned short* depth_data = depth_crop.ptr<unsigned short>(row);
+      if (!has_depth) {
+        std::fill(depth_data, depth_data + roi.width, (unsigned short) NO_DEPTH);
+        continue;
+      }
+      const float* src_data = depth.ptr<float>(roi.y + row) + roi.x;
+      for (int col = 0; col < roi.width; ++col)
+        depth_data[col] = (image_utils::is_nan_depth(src_data[col]) ? NO_DEPTH
+                           : cv::saturate_cast<unsigned short>(1000 * src_data[col]));
+    } // end loop row
+    return true;
+  } // end push();
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * Get the last crop stored at or before \a timestamp, without copy.
+   * \param roi
+   *    the crop in its frame
+   * \param color, user, depth_mm
+   *    headers on the arena, valid until the next push()
+   * \param max_age
+   *    the crop must be stored after timestamp - max_age, in seconds
+   * \return false if there is no crop that old, or it is too old
+   */
+  bool get(const double timestamp, cv::Rect & roi, cv::Mat3b & color,
+           cv::Mat1b & user, cv::Mat1w & depth_mm,
+           const double max_age = std::numeric_limits<double>::max()) const {
+    for (int i = (int) _count - 1; i >= 0; --i) {
+      const Entry & entry = _entries[(_head + i) % _entries.size()];
+      if (entry.timestamp > timestamp)
+        continue;
+      if (entry.timestamp < timestamp - max_age) // a gap in the history
+        return false;
+      roi = entry.roi;
+      get_mats(entry, color, user, depth_mm);
+      return true;
+    } // end loop i
+    return false;
+  } // end get();
+
+private:
+  //////////////////////////////////////////////////////////////////////////////
+
+  inline const Entry & oldest() const { return _entries[_head]; }
+
+  inline void pop_oldest() {
+    _head = (_head + 1) % _entries.size();
+    --_count;
+  }
+
+  static inline bool overlaps(const Entry & entry, size_t pos, size_t bytes) {
+    return entry.offset < pos + bytes && pos < entry.offset + entry.bytes;
+  }
+
+  //! the headers of the crop of \a entry: depth (aligned), then color, then labels
+  inline void get_mats(const Entry & entry, cv::Mat3b & color,
+                       cv::Mat1b & user, cv::Mat1w & depth_mm) const {
+    uchar* data = (uchar*) &(_arena[entry.offset]);
+    int w = entry.roi.width, h = entry.roi.height;
+    depth_mm = cv::Mat1w(h, w, (unsigned short*) data);
+    color = cv::Mat3b(h, w, (cv::Vec3b*) (data + 2 * w * h));
+    user = cv::Mat1b(h, w, data + 5 * w * h);
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  size_t _arena_bytes;
+  std::vector<uchar> _arena;
+  //! the ring of entries, from _head to _head + _count - 1, oldest first
+  std::vector<Entry> _entries;
+  unsigned int _head, _count;
+  //! where the next crop should be written in the arena
+  size_t _write_offset;
+}; // end class UserCropHistory
+
+#endif // USER_CROP_HISTORY_H
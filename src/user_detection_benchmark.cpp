@@ -0,0 +1,252 @@
+/*!
+  \file        user_detection_benchmark.cpp
+  \author      Arnaud Ramey <arnaud.a.ramey@gmail.com>
+                -- Robotics Lab, University Carlos III of Madrid
+  \date        2013/10/20
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+
+Replays recorded sequences (cf. rgbd_sequence.h, key 'r' in nite_fx)
+and runs every user detector on every frame.
+
+For each detector and frame, it writes a CSV line with:
+  - the latency of the detector, in milliseconds
+  - the IoU of the user pixels with the reference
+  - the boundary F-score, with a tolerance of BOUNDARY_TOLERANCE pixels
+  - the number of ID switches: reference users whose best matching
+    detected label changed since the previous frame
+
+The reference is the hand-labelled user map (gt_*.png) if there is one
+for the frame, the NITE user map otherwise.
+NITE itself is only scored on the frames with a hand-labelled map,
+and its latency is N/A: its user map is computed by the driver.
+
+\section Usage
+  user_detection_benchmark OUTPUT.csv SEQUENCE_FOLDER [SEQUENCE_FOLDER...]
+
+ */
+#define NITE_FX
+#include <fstream>
+#include "rgbd_sequence.h"
+#include "morph_utils.h"
+#include "timer.h"
+#include "get_depth_blobs.h"
+#include "depth_background_remover.h"
+
+//! the distance, in pixels, under which boundaries are matched
+static const int BOUNDARY_TOLERANCE = 2;
+
+enum Detector {
+  DETECTOR_NITE = 0,
+  DETECTOR_DEPTH_BLOB = 1,
+  DETECTOR_DEPTH_BACKGROUND_REMOVER = 2,
+  NB_DETECTORS = 3
+};
+static const char* DETECTOR_NAMES[NB_DETECTORS] = {
+  "NITE", "depth_blob", "background_remover"
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+//! the pixels of \a mask (255) that have a 4-neighbour out of it
+void boundary(const cv::Mat1b & mask, cv::Mat1b & out,
+              image_utils::MaskMorphology & morph) {
+  morph.erode_rect(mask, out, 3, 3);
+  for (int row = 0; row < mask.rows; ++row) {
+    const uchar* mask_data = mask.ptr<uchar>(row);
+    uchar* out_data = out.ptr<uchar>(row);
+    for (int col = 0; col < mask.cols; ++col)
+      out_data[col] = (mask_data[col] != 0 && out_data[col] == 0 ? 255 : 0);
+  } // end loop row
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+//! the proportion of the pixels of \a a that are in \a b_zone, 1 if \a a is empty
+double match_ratio(const cv::Mat1b & a, const cv::Mat1b & b_zone) {
+  int total = 0, matched = 0;
+  for (int row = 0; row < a.rows; ++row) {
+    const uchar* a_data = a.ptr<uchar>(row);
+    const uchar* b_data = b_zone.ptr<uchar>(row);
+    for (int col = 0; col < a.cols; ++col) {
+      if (a_data[col] == 0)
+        continue;
+      ++total;
+      if (b_data[col] != 0)
+        ++matched;
+    } // end loop col
+  } // end loop row
+  return (total == 0 ? 1 : 1. * matched / total);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+class DetectorScore {
+public:
+  DetectorScore() {
+    std::fill(_last_match, _last_match + 256, 0);
+    total_switches = 0;
+  }
+
+  //! compute the scores of \a det against \a ref
+  void compute(const cv::Mat1b & ref, const cv::Mat1b & det) {
+    // IoU and the overlaps between labels
+    _overlap.assign(256 * 256, 0);
+    int inter = 0, uni = 0;
+    for (int row = 0; row < ref.rows; ++row) {
+      const uchar* ref_data = ref.ptr<uchar>(row);
+      const uchar* det_data = det.ptr<uchar>(row);
+      for (int col = 0; col < ref.cols; ++col) {
+        bool in_ref = (ref_data[col] != 0), in_det = (det_data[col] != 0);
+        if (in_ref && in_det)
+          ++inter;
+        if (in_ref || in_det)
+          ++uni;
+        if (in_ref)
+          ++_overlap[256 * ref_data[col] + det_data[col]];
+      } // end loop col
+    } // end loop row
+    iou = (uni == 0 ? 1 : 1. * inter / uni);
+
+    // boundary F-score
+    cv::threshold(ref, _ref_mask, 0, 255, CV_THRESH_BINARY);
+    cv::threshold(det, _det_mask, 0, 255, CV_THRESH_BINARY);
+    boundary(_ref_mask, _ref_boundary, _morph);
+    boundary(_det_mask, _det_boundary, _morph);
+    int zone = 2 * BOUNDARY_TOLERANCE + 1;
+    _morph.dilate_rect(_ref_boundary, _ref_zone, zone, zone);
+    _morph.dilate_rect(_det_boundary, _det_zone, zone, zone);
+    double precision = match_ratio(_det_boundary, _ref_zone);
+    double recall = match_ratio(_ref_boundary, _det_zone);
+    boundary_f = (precision + recall == 0 ? 0
+                  : 2 * precision * recall / (precision + recall));
+
+    // ID switches: the best detected label of each reference user
+    id_switches = 0;
+    for (int ref_label = 1; ref_label < 256; ++ref_label) {
+      const int* overlap = &(_overlap[256 * ref_label]);
+      int best_label = 0, best_overlap = 0;
+      for (int det_label = 1; det_label < 256; ++det_label) {
+        if (overlap[det_label] > best_overlap) {
+          best_overlap = overlap[det_label];
+          best_label = det_label;
+        }
+      } // end loop det_label
+      if (best_label == 0) // user not detected, keep the last match
+        continue;
+      if (_last_match[ref_label] != 0 && _last_match[ref_label] != best_label)
+        ++id_switches;
+      _last_match[ref_label] = best_label;
+    } // end loop ref_label
+    total_switches += id_switches;
+  } // end compute();
+
+  double iou, boundary_f;
+  int id_switches;
+  int total_switches;
+
+private:
+  std::vector<int> _overlap;
+  int _last_match[256];
+  image_utils::MaskMorphology _morph;
+  cv::Mat1b _ref_mask, _det_mask, _ref_boundary, _det_boundary,
+  _ref_zone, _det_zone;
+}; // end class DetectorScore
+
+////////////////////////////////////////////////////////////////////////////////
+
+void benchmark_sequence(const std::string & folder, std::ofstream & out) {
+  rgbd_sequence::Reader reader;
+  reader.open(folder);
+  // fresh detectors for each sequence
+  GetDepthBlobs depth_blobs;
+  DepthBackgroundRemover depth_background_remover;
+  DetectorScore scores[NB_DETECTORS];
+  double total_latency[NB_DETECTORS];
+  std::fill(total_latency, total_latency + NB_DETECTORS, 0);
+  cv::Mat3b color, img_out;
+  cv::Mat1f depth;
+  cv::Mat1b user, gt;
+  kinect::NiteSkeletonList skeleton_list;
+  int nframes = 0;
+  while (reader.read(color, depth, user, gt)) {
+    bool has_gt = !gt.empty();
+    const cv::Mat1b & ref = (has_gt ? gt : user);
+    for (int detector = 0; detector < NB_DETECTORS; ++detector) {
+      // without ground truth, NITE would be scored against itself
+      if (detector == DETECTOR_NITE && !has_gt)
+        continue;
+      Timer timer;
+      const cv::Mat1b* det = &user;
+      if (detector == DETECTOR_DEPTH_BLOB) {
+        depth_blobs.fn(color, depth, user, skeleton_list, img_out);
+        det = &depth_blobs.fake_user;
+      }
+      else if (detector == DETECTOR_DEPTH_BACKGROUND_REMOVER) {
+        depth_background_remover.fn(color, depth, user, skeleton_list, img_out);
+        det = &depth_background_remover.fake_user;
+      }
+      double latency = timer.getTimeMilliseconds();
+      total_latency[detector] += latency;
+      DetectorScore & score = scores[detector];
+      score.compute(ref, *det);
+      out << folder << "," << DETECTOR_NAMES[detector] << ","
+          << reader.frame_idx() << "," << (has_gt ? "gt" : "NITE") << ",";
+      // the NITE user map is computed by the driver, out of this process
+      if (detector == DETECTOR_NITE)
+        out << "N/A";
+      else
+        out << latency;
+      out << "," << score.iou << "," << score.boundary_f << ","
+          << score.id_switches << std::endl;
+    } // end loop detector
+    ++nframes;
+  } // end while (reader.read())
+
+  maggiePrint("Sequence '%s': %i frames", folder.c_str(), nframes);
+  for (int detector = 0; detector < NB_DETECTORS && nframes > 0; ++detector) {
+    if (detector == DETECTOR_NITE) {
+      maggiePrint("  %s: latency N/A, %i ID switches",
+                  DETECTOR_NAMES[detector], scores[detector].total_switches);
+      continue;
+    }
+    maggiePrint("  %s: mean latency %g ms, %i ID switches",
+                DETECTOR_NAMES[detector], total_latency[detector] / nframes,
+                scores[detector].total_switches);
+  } // end loop detector
+} // end benchmark_sequence();
+
+////////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    printf("Synopsis: %s OUTPUT.csv SEQUENCE_FOLDER [SEQUENCE_FOLDER...]\n",
+           argv[0]);
+    return -1;
+  }
+  std::ofstream out(argv[1]);
+  if (!out.is_open()) {
+    maggiePrint("Impossible to open '%s'", argv[1]);
+    return -1;
+  }
+  out << "sequence,detector,frame,reference,latency_ms,iou,boundary_f,id_switches"
+      << std::endl;
+  for (int arg_idx = 2; arg_idx < argc; ++arg_idx)
+    benchmark_sequence(argv[arg_idx], out);
+  out.close();
+  return 0;
+}
@@ -0,0 +1,237 @@
+/*!
+  \file        user_stats.h
+  \author      Arnaud Ramey <arnaud.a.ramey@gmail.com>
+                -- Robotics Lab, University Carlos III of Madrid
+  \date        2013/10/20
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+
+\class UserStats
+\brief Statistics of every label of a user map, computed in a single sweep:
+area, bounding box, centroid, second moments,
+and min / mean / median depth if a depth image is supplied.
+
+Once computed, the stats of a given user are obtained in O(1).
+
+ */
+
+#ifndef USER_STATS_H
+#define USER_STATS_H
+
+#include <opencv2/core/core.hpp>
+#include <limits>
+#include "nan_handling.h"
+
+class UserStats {
+public:
+  //! the number of possible labels in a uchar user map
+  static const int MAX_LABELS = 256;
+  //! the width of the bins for the depth median, in centimeters
+  static const int DEPTH_BIN_CM = 1;
+  //! the number of bins for the depth median (10 meters)
+  static const int DEPTH_NBINS = 1000;
+
+  struct Stats {
+    //! the number of pixels of the user
+    int area;
+    //! the bounding box of the user pixels
+    cv::Rect bbox;
+    //! the center of mass of the user pixels
+    cv::Point2f centroid;
+    //! the central second moments, normalized by the area (covariance)
+    double mu20, mu11, mu02;
+    //! the number of user pixels with a defined depth
+    int depth_count;
+    //! the depth stats, in meters. 0 if depth_count = 0
+    float depth_min, depth_mean, depth_median;
+  };
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  UserStats() {
+    _present.resize(MAX_LABELS, false);
+    _acc.resize(MAX_LABELS);
+    _stats.resize(MAX_LABELS);
+    _nhists = 0;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * Compute the stats of all non-null labels of \a user.
+   * \param depth
+   *    if not empty, of the same size as \a user. Undefined depth is skipped.
+   */
+  void compute(const cv::Mat1b & user, const cv::Mat1f & depth = cv::Mat1f()) {
+    // reset the accumulators of the labels seen last time
+    for (unsigned int i = 0; i < _labels.size(); ++i) {
+      uchar label = _labels[i];
+      _present[label] = false;
+    }
+    _labels.clear();
+    _nhists = 0;
+    bool use_depth = (!depth.empty() && depth.size() == user.size());
+
+    for (int row = 0; row < user.rows; ++row) {
+      const uchar* user_data = user.ptr<uchar>(row);
+      const float* depth_data = (use_depth ? depth.ptr<float>(row) : NULL);
+      int col = 0;
+      while (col < user.cols) {
+        uchar label = user_data[col];
+        if (label == 0) {
+          ++col;
+          continue;
+        }
+        // find the run of identical labels [col, end_col[
+        int end_col = col + 1;
+        while (end_col < user.cols && user_data[end_col] == label)
+          ++end_col;
+        Accumulator & acc = get_accumulator(label, row, col, use_depth);
+        // add the run in closed form
+        int64_t n = end_col - col, first = col, last = end_col - 1;
+        acc.n += n;
+        acc.sx += n * (first + last) / 2;
+        acc.sy += n * row;
+        acc.sxx += (last * (last + 1) * (2 * last + 1)
+                    - (first - 1) * first * (2 * first - 1)) / 6;
+        acc.sxy += row * n * (first + last) / 2;
+        acc.syy += n * row * row;
+        acc.xmin = std::min(acc.xmin, (int) first);
+        acc.xmax = std::max(acc.xmax, (int) last);
+        acc.ymax = row;
+        // depth of the run
+        if (use_depth) {
+          int* hist = &(_hists[acc.hist_idx * DEPTH_NBINS]);
+          for (int c = col; c < end_col; ++c) {
+            float d = depth_data[c];
+            if (image_utils::is_nan_depth(d))
+              continue;
+            ++acc.depth_count;
+            acc.depth_sum += d;
+            if (d < acc.depth_min)
+              acc.depth_min = d;
+            int bin = std::min(DEPTH_NBINS - 1, (int) (d * 100 / DEPTH_BIN_CM));
+            ++hist[bin];
+          } // end loop c
+        }
+        col = end_col;
+      } // end while (col < user.cols)
+    } // end loop row
+
+    // convert the accumulators into stats
+    for (unsigned int i = 0; i < _labels.size(); ++i) {
+      uchar label = _labels[i];
+      const Accumulator & acc = _acc[label];
+      Stats & s = _stats[label];
+      s.area = acc.n;
+      s.bbox = cv::Rect(acc.xmin, acc.ymin,
+                        acc.xmax - acc.xmin + 1, acc.ymax - acc.ymin + 1);
+      double cx = 1. * acc.sx / acc.n, cy = 1. * acc.sy / acc.n;
+      s.centroid = cv::Point2f(cx, cy);
+      s.mu20 = 1. * acc.sxx / acc.n - cx * cx;
+      s.mu11 = 1. * acc.sxy / acc.n - cx * cy;
+      s.mu02 = 1. * acc.syy / acc.n - cy * cy;
+      s.depth_count = acc.depth_count;
+      s.depth_min = s.depth_mean = s.depth_median = 0;
+      if (acc.depth_count == 0)
+        continue;
+      s.depth_min = acc.depth_min;
+      s.depth_mean = acc.depth_sum / acc.depth_count;
+      // median from the histogram
+      const int* hist = &(_hists[acc.hist_idx * DEPTH_NBINS]);
+      int half = (acc.depth_count + 1) / 2, cumul = 0;
+      for (int bin = 0; bin < DEPTH_NBINS; ++bin) {
+        cumul += hist[bin];
+        if (cumul >= half) {
+          s.depth_median = (bin + .5f) * DEPTH_BIN_CM / 100.f;
+          break;
+        }
+      } // end loop bin
+    } // end loop i
+  } // end compute();
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! \return true if \a label was present in the last computed user map
+  inline bool has_user(const uchar label) const { return _present[label]; }
+
+  //! the stats of a label. Only valid if has_user(label)
+  inline const Stats & get(const uchar label) const { return _stats[label]; }
+
+  //! the non-null labels present in the last computed user map
+  inline const std::vector<uchar> & labels() const { return _labels; }
+
+  //! the union of the bounding boxes of all labels in [min_label, max_label]
+  inline cv::Rect bbox_union(const uchar min_label = 1,
+                             const uchar max_label = 255) const {
+    cv::Rect ans;
+    bool first = true;
+    for (unsigned int i = 0; i < _labels.size(); ++i) {
+      uchar label = _labels[i];
+      if (label < min_label || label > max_label)
+        continue;
+      ans = (first ? _stats[label].bbox : (ans | _stats[label].bbox));
+      first = false;
+    }
+    return ans;
+  }
+
+private:
+  struct Accumulator {
+    int64_t n, sx, sy, sxx, sxy, syy;
+    int xmin, xmax, ymin, ymax;
+    int depth_count;
+    double depth_sum;
+    float depth_min;
+    int hist_idx;
+  };
+
+  //! get the accumulator of a label, initializing it the first time
+  inline Accumulator & get_accumulator(const uchar label, int row, int col,
+                                       bool use_depth) {
+    Accumulator & acc = _acc[label];
+    if (_present[label])
+      return acc;
+    _present[label] = true;
+    _labels.push_back(label);
+    acc.n = acc.sx = acc.sy = acc.sxx = acc.sxy = acc.syy = 0;
+    acc.xmin = acc.xmax = col;
+    acc.ymin = acc.ymax = row;
+    acc.depth_count = 0;
+    acc.depth_sum = 0;
+    acc.depth_min = std::numeric_limits<float>::max();
+    acc.hist_idx = -1;
+    if (use_depth) { // allocate a histogram only for the labels present
+      acc.hist_idx = _nhists++;
+      if (_hists.size() < (size_t) _nhists * DEPTH_NBINS)
+        _hists.resize(_nhists * DEPTH_NBINS);
+      std::fill(_hists.begin() + acc.hist_idx * DEPTH_NBINS,
+                _hists.begin() + _nhists * DEPTH_NBINS, 0);
+    }
+    return acc;
+  }
+
+  std::vector<bool> _present;
+  std::vector<uchar> _labels;
+  std::vector<Accumulator> _acc;
+  std::vector<Stats> _stats;
+  //! the depth histograms of the present labels, DEPTH_NBINS per label
+  std::vector<int> _hists;
+  int _nhists;
+}; // end class UserStats
+
+#endif // USER_STATS_H
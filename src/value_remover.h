@@ -8,6 +8,7 @@
 #endif // CV_MAJOR_VERSION == 2 && CV_MINOR_VERSION >= 4
 // AD
 #include "border_remover.h"
+#include "morph_utils.h"
 #include "debug.h"
 
 namespace image_utils {
@@ -49,6 +50,151 @@ inline void remove_value_left_propagation(cv::Mat_<_T> & src,
 
 ////////////////////////////////////////////////////////////////////////////////
 
+/*! Fills the pixels of a mask by interpolating the valid pixels around them,
+  without any sentinel value.
+  A horizontal sweep interpolates linearly between the valid pixels
+  on the left and on the right of each masked run,
+  a vertical sweep between the valid pixels above and below.
+  Both are averaged, weighted by the inverse of the length of their gap.
+  Only the bounding box of the mask is processed.
+  The vertical sweep goes along rows, with one state per column,
+  so that both sweeps read the memory in order.
+*/
+class MaskFiller {
+public:
+  /*!
+   * \param img
+   *    an image of uchar, any number of channels. Modified in place.
+   * \param mask
+   *    the pixels to fill (!= 0)
+   */
+  void fill(cv::Mat & img, const cv::Mat1b & mask) {
+    cv::Rect bbox = nonzero_bbox(mask);
+    if (bbox.width == 0)
+      return;
+    // the valid pixels bracketing the mask are in the bbox grown by 1
+    cv::Rect roi(bbox.x - 1, bbox.y - 1, bbox.width + 2, bbox.height + 2);
+    roi &= cv::Rect(0, 0, mask.cols, mask.rows);
+    const int cn = img.channels(), cols = roi.width, rows = roi.height;
+    // the gap weight of a one-sided interpolation: only a fallback
+    const float one_sided_gap = 4.f * (cols + rows);
+    _h_value.resize(rows * cols * cn);
+    _h_gap.resize(rows * cols);
+    _down.resize(rows * cols);
+
+    // horizontal sweep
+    for (int row = 0; row < rows; ++row) {
+      const uchar* mask_data = mask.ptr<uchar>(roi.y + row) + roi.x;
+      const uchar* img_data = img.ptr<uchar>(roi.y + row) + roi.x * cn;
+      float* h_value = &(_h_value[row * cols * cn]);
+      float* h_gap = &(_h_gap[row * cols]);
+      int col = 0;
+      while (col < cols) {
+        if (mask_data[col] == 0) {
+          ++col;
+          continue;
+        }
+        // masked run [begin, end[
+        int begin = col;
+        while (col < cols && mask_data[col] != 0)
+          ++col;
+        int end = col;
+        bool has_left = (begin > 0), has_right = (end < cols);
+        const uchar* left = img_data + (begin - 1) * cn;
+        const uchar* right = img_data + end * cn;
+        float gap = end - begin + 1;
+        for (int run_col = begin; run_col < end; ++run_col) {
+          float* value = h_value + run_col * cn;
+          if (has_left && has_right) {
+            float t = (run_col - begin + 1) / gap;
+            for (int c = 0; c < cn; ++c)
+              value[c] = left[c] + t * (right[c] - left[c]);
+            h_gap[run_col] = gap;
+          }
+          else if (has_left || has_right) {
+            const uchar* side = (has_left ? left : right);
+            for (int c = 0; c < cn; ++c)
+              value[c] = side[c];
+            h_gap[run_col] = one_sided_gap;
+          }
+          else
+            h_gap[run_col] = 0; // whole row masked
+        } // end loop run_col
+      } // end while (col < cols)
+    } // end loop row
+
+    // vertical sweep, bottom-up: the next valid row below each pixel
+    _last_valid_row.assign(cols, -1);
+    for (int row = rows - 1; row >= 0; --row) {
+      const uchar* mask_data = mask.ptr<uchar>(roi.y + row) + roi.x;
+      int* down = &(_down[row * cols]);
+      for (int col = 0; col < cols; ++col) {
+        down[col] = _last_valid_row[col];
+        if (mask_data[col] == 0)
+          _last_valid_row[col] = row;
+      } // end loop col
+    } // end loop row
+
+    // vertical sweep, top-down: interpolate and blend with the horizontal one
+    _last_valid_row.assign(cols, -1);
+    for (int row = 0; row < rows; ++row) {
+      const uchar* mask_data = mask.ptr<uchar>(roi.y + row) + roi.x;
+      uchar* img_data = img.ptr<uchar>(roi.y + row) + roi.x * cn;
+      const float* h_value = &(_h_value[row * cols * cn]);
+      const float* h_gap = &(_h_gap[row * cols]);
+      const int* down = &(_down[row * cols]);
+      for (int col = 0; col < cols; ++col) {
+        if (mask_data[col] == 0) {
+          _last_valid_row[col] = row;
+          continue;
+        }
+        int up_row = _last_valid_row[col], down_row = down[col];
+        const uchar* up = (up_row < 0 ? NULL
+                           : img.ptr<uchar>(roi.y + up_row) + (roi.x + col) * cn);
+        const uchar* dn = (down_row < 0 ? NULL
+                           : img.ptr<uchar>(roi.y + down_row) + (roi.x + col) * cn);
+        float v_gap = 0, t = 0;
+        if (up && dn) {
+          v_gap = down_row - up_row;
+          t = 1.f * (row - up_row) / v_gap;
+        }
+        else if (up || dn)
+          v_gap = one_sided_gap;
+        float w_h = (h_gap[col] > 0 ? 1.f / h_gap[col] : 0),
+            w_v = (v_gap > 0 ? 1.f / v_gap : 0);
+        if (w_h + w_v == 0) // no valid pixel in the row nor the column
+          continue;
+        for (int c = 0; c < cn; ++c) {
+          float v = 0;
+          if (up && dn)
+            v = up[c] + t * (dn[c] - up[c]);
+          else if (up || dn)
+            v = (up ? up[c] : dn[c]);
+          float h = (w_h > 0 ? h_value[col * cn + c] : 0);
+          img_data[col * cn + c] =
+              cv::saturate_cast<uchar>((w_h * h + w_v * v) / (w_h + w_v));
+        } // end loop c
+      } // end loop col
+    } // end loop row
+  } // end fill();
+
+private:
+  //! the horizontal interpolation of each pixel of the roi, and its gap
+  std::vector<float> _h_value, _h_gap;
+  //! the row of the next valid pixel below each pixel of the roi, -1 if none
+  std::vector<int> _down;
+  //! the state of the vertical sweeps: the last valid row of each column
+  std::vector<int> _last_valid_row;
+}; // end class MaskFiller
+
+//! drop-in version of MaskFiller::fill()
+inline void fill_masked(cv::Mat & img, const cv::Mat1b & mask) {
+  MaskFiller filler;
+  filler.fill(img, mask);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 enum NaNRemovalMethod {
   VALUE_REMOVAL_METHOD_DO_NOTHING = 0,
   VALUE_REMOVAL_METHOD_DIRECTIONAL_VALUE_PROPAGATION = 1,
@@ -0,0 +1,344 @@
+/*!
+  \file        video_frame_cache.h
+  \author      Arnaud Ramey <arnaud.a.ramey@gmail.com>
+                -- Robotics Lab, University Carlos III of Madrid
+  \date        2013/10/20
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+
+\class VideoFrameCache
+\brief All the frames of a short video, decoded and resized once,
+stored raw in a file that is memory-mapped.
+
+The cache file is in LONG_TERM_MEMORY_DIR, named after the video and the size.
+It starts with a \a Header, followed by the BGR frames.
+The header stores the size and modification time of the video:
+if the video was replaced, the cache is rebuilt.
+If it already exists and is valid, start() just maps it.
+Otherwise, the video is decoded in a background thread;
+is_ready() becomes true when the file is written and mapped.
+If the file cannot be written, the frames are kept in RAM,
+up to a given size.
+
+Getting a frame is then a single copy from the read-only mapping.
+close() cancels a build in progress: the builder checks it at each frame.
+
+ */
+
+#ifndef VIDEO_FRAME_CACHE_H
+#define VIDEO_FRAME_CACHE_H
+
+#include <boost/thread.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <cstring>
+#include <sstream>
+#include <stdint.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "ltm_path.h"
+#include "std_utils.h"
+#include "debug.h"
+
+class VideoFrameCache {
+public:
+  struct Header {
+    char magic[8];
+    int version;
+    int width, height, nframes;
+    double fps;
+    //! the size and modification time of the video file
+    int64_t video_bytes, video_mtime;
+  };
+  static const int VERSION = 2;
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * \param max_ram_bytes
+   *    if the cache file cannot be written, the max size of the frames in RAM
+   */
+  VideoFrameCache(const size_t max_ram_bytes = 512 * 1024 * 1024)
+    : _max_ram_bytes(max_ram_bytes), _video_bytes(-1), _video_mtime(-1), _ready(false), _running(false), _cancel(false),
+      _map(NULL), _map_bytes(0), _frames(NULL) {}
+
+  ~VideoFrameCache() { close(); }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * Map the cache of \a video_filename at \a size,
+   * or start building it in a background thread.
+   */
+  void start(const std::string & video_filename, const cv::Size & size) {
+    close();
+    _video_filename = video_filename;
+    _size = size;
+    struct stat video_st;
+    if (stat(video_filename.c_str(), &video_st) == 0) {
+      _video_bytes = video_st.st_size;
+      _video_mtime = video_st.st_mtime;
+    }
+    else
+      _video_bytes = _video_mtime = -1;
+    _cache_filename = cache_filename(video_filename, size);
+    if (map_file()) {
+      maggieDebug2("VideoFrameCache: mapped '%s', %i frames",
+                   _cache_filename.c_str(), _header.nframes);
+      return;
+    }
+    maggiePrint("VideoFrameCache: building '%s'", _cache_filename.c_str());
+    set_cancel(false);
+    _running = true;
+    _thread = boost::thread(&VideoFrameCache::build, this);
+  } // end start();
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! cancel the build if any, and unmap the file, or free the RAM
+  void close() {
+    if (_running) {
+      set_cancel(true);
+      _thread.join();
+      _running = false;
+    }
+    if (_map != NULL)
+      munmap(_map, _map_bytes);
+    _map = NULL;
+    _map_bytes = 0;
+    _frames = NULL;
+    _ram.clear();
+    set_ready(false);
+  } // end close();
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! true when the frames can be read
+  inline bool is_ready() {
+    boost::mutex::scoped_lock lock(_mutex);
+    return _ready;
+  }
+
+  //! the number of frames. Only valid if is_ready()
+  inline int nframes() const { return _header.nframes; }
+  //! the frame rate of the video. Only valid if is_ready()
+  inline double fps() const { return _header.fps; }
+  inline const cv::Size & size() const { return _size; }
+
+  //! copy frame \a frame_idx into \a out. Only valid if is_ready()
+  inline void copy_frame(const int frame_idx, cv::Mat3b & out) const {
+    frame_header(frame_idx).copyTo(out);
+  }
+
+  //! \a out = (1 - weight2) * frame1 + weight2 * frame2. Only valid if is_ready()
+  inline void blend_frames(const int frame_idx1, const int frame_idx2,
+                           const double weight2, cv::Mat3b & out) const {
+    cv::addWeighted(frame_header(frame_idx1), 1 - weight2,
+                    frame_header(frame_idx2), weight2, 0, out);
+  }
+
+private:
+  //////////////////////////////////////////////////////////////////////////////
+
+  inline size_t frame_bytes() const { return 3 * _size.width * _size.height; }
+
+  /*!
+   * A header on frame \a frame_idx, without copy.
+   * The mapping is read-only: it must never be written.
+   */
+  inline const cv::Mat3b frame_header(const int frame_idx) const {
+    return cv::Mat3b(_size.height, _size.width,
+                     (cv::Vec3b*) (_frames + frame_idx * frame_bytes()));
+  }
+
+  inline void set_cancel(bool cancel) {
+    boost::mutex::scoped_lock lock(_mutex);
+    _cancel = cancel;
+  }
+
+  inline bool is_cancelled() {
+    boost::mutex::scoped_lock lock(_mutex);
+    return _cancel;
+  }
+
+  inline void set_ready(bool ready) {
+    boost::mutex::scoped_lock lock(_mutex);
+    _ready = ready;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! for instance LONG_TERM_MEMORY_DIR "news.m4v_640x480.raw"
+  static std::string cache_filename(const std::string & video_filename,
+                                    const cv::Size & size) {
+    size_t slash = video_filename.find_last_of('/');
+    std::string basename = (slash == std::string::npos ? video_filename
+                            : video_filename.substr(slash + 1));
+    std::ostringstream out;
+    out << LONG_TERM_MEMORY_DIR << basename << "_"
+        << size.width << "x" << size.height << ".raw";
+    return out.str();
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! \return true if the cache file exists, is valid and was mapped
+  bool map_file() {
+    int fd = open(_cache_filename.c_str(), O_RDONLY);
+    if (fd < 0)
+      return false;
+    struct stat st;
+    bool ok = (fstat(fd, &st) == 0 && (size_t) st.st_size >= sizeof(Header));
+    if (ok)
+      ok = (read(fd, &_header, sizeof(Header)) == (ssize_t) sizeof(Header));
+    if (ok)
+      ok = (strncmp(_header.magic, "NFXCACHE", 8) == 0
+            && _header.version == VERSION
+            && _header.width == _size.width && _header.height == _size.height
+            && _header.nframes > 0
+            && _video_bytes >= 0 // the video must exist to check the cache
+            && _header.video_bytes == _video_bytes
+            && _header.video_mtime == _video_mtime
+            && (size_t) st.st_size
+            == sizeof(Header) + _header.nframes * frame_bytes());
+    if (ok) {
+      void* map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+      ok = (map != MAP_FAILED);
+      if (ok) {
+        _map = map;
+        _map_bytes = st.st_size;
+        _frames = (const uchar*) map + sizeof(Header);
+        set_ready(true);
+      }
+    }
+    ::close(fd);
+    return ok;
+  } // end map_file();
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! the builder thread: decode the video into the file, or in RAM
+  void build() {
+    cv::VideoCapture capture(_video_filename);
+    if (!capture.isOpened()) {
+      maggiePrint("VideoFrameCache: cannot open '%s'", _video_filename.c_str());
+      return;
+    }
+    std::memcpy(_header.magic, "NFXCACHE", 8);
+    _header.version = VERSION;
+    _header.width = _size.width;
+    _header.height = _size.height;
+    _header.nframes = 0;
+    _header.fps = capture.get(CV_CAP_PROP_FPS);
+    _header.video_bytes = _video_bytes;
+    _header.video_mtime = _video_mtime;
+    std_utils::exec_system("mkdir -p " LONG_TERM_MEMORY_DIR);
+    // write in a temporary file, renamed when complete
+    std::string tmp_filename = _cache_filename + ".tmp";
+    FILE* file = fopen(tmp_filename.c_str(), "wb");
+    if (file != NULL && fwrite(&_header, sizeof(Header), 1, file) != 1) {
+      fclose(file);
+      file = NULL;
+    }
+    bool keep_in_ram = (file == NULL);
+    cv::Mat decoded;
+    cv::Mat3b resized;
+    while (capture.read(decoded)) {
+      if (is_cancelled()) {
+        maggieDebug2("VideoFrameCache: build of '%s' cancelled",
+                     _cache_filename.c_str());
+        if (file != NULL) {
+          fclose(file);
+          remove(tmp_filename.c_str());
+        }
+        _ram.clear();
+        return;
+      }
+      cv::resize(decoded, resized, _size);
+      if (file != NULL
+          && fwrite(resized.data, frame_bytes(), 1, file) != 1) {
+        maggiePrint("VideoFrameCache: cannot write '%s', keeping frames in RAM",
+                    tmp_filename.c_str());
+        fclose(file);
+        remove(tmp_filename.c_str());
+        file = NULL;
+        keep_in_ram = true;
+        // re-decode from the start in RAM
+        _header.nframes = 0;
+        capture.set(CV_CAP_PROP_POS_FRAMES, 0);
+        continue;
+      }
+      if (keep_in_ram) {
+        if (_ram.size() + frame_bytes() > _max_ram_bytes) {
+          maggiePrint("VideoFrameCache: video too long for RAM, cut at %i frames",
+                      _header.nframes);
+          break;
+        }
+        _ram.insert(_ram.end(), resized.data, resized.data + frame_bytes());
+      }
+      ++_header.nframes;
+    } // end while (capture.read())
+
+    if (file != NULL) {
+      // rewrite the header with the number of frames
+      bool ok = (fseek(file, 0, SEEK_SET) == 0
+                 && fwrite(&_header, sizeof(Header), 1, file) == 1);
+      ok = (fclose(file) == 0) && ok;
+      if (ok && _header.nframes > 0
+          && rename(tmp_filename.c_str(), _cache_filename.c_str()) == 0
+          && map_file()) {
+        maggiePrint("VideoFrameCache: '%s' built, %i frames",
+                    _cache_filename.c_str(), _header.nframes);
+        return;
+      }
+      maggiePrint("VideoFrameCache: could not build '%s'",
+                  _cache_filename.c_str());
+      remove(tmp_filename.c_str());
+      return;
+    }
+    if (_header.nframes > 0) {
+      _frames = &(_ram[0]);
+      set_ready(true);
+    }
+  } // end build();
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  size_t _max_ram_bytes;
+  std::string _video_filename, _cache_filename;
+  //! the size and modification time of the video file, -1 if it does not exist
+  int64_t _video_bytes, _video_mtime;
+  cv::Size _size;
+  Header _header;
+  bool _ready, _running;
+  //! set by close() to stop the builder thread
+  bool _cancel;
+  boost::mutex _mutex;
+  boost::thread _thread;
+  //! the mapped file
+  void* _map;
+  size_t _map_bytes;
+  //! the frames when not in a file
+  std::vector<uchar> _ram;
+  //! the first frame, in the file or in RAM
+  const uchar* _frames;
+}; // end class VideoFrameCache
+
+#endif // VIDEO_FRAME_CACHE_H
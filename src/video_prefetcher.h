@@ -0,0 +1,238 @@
+/*!
+  \file        video_prefetcher.h
+  \author      Arnaud Ramey <arnaud.a.ramey@gmail.com>
+                -- Robotics Lab, University Carlos III of Madrid
+  \date        2013/10/20
+
+________________________________________________________________________________
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+________________________________________________________________________________
+
+\class VideoPrefetcher
+\brief Decodes and resizes a looping video in a producer thread.
+
+The producer fills a ring of frames at the wanted size.
+When it reaches the end of the video, it rewinds it itself,
+so the consumer never waits for a seek.
+The consumer takes the frames with pop(), that swaps the buffers
+instead of copying them.
+
+Each frame has a presentation timestamp, in seconds since the start
+of the playback, that keeps increasing when the video loops.
+pop_until() gives the frame to show at a given time,
+skipping the frames that are too old.
+
+ */
+
+#ifndef VIDEO_PREFETCHER_H
+#define VIDEO_PREFETCHER_H
+
+#include <boost/thread.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include "debug.h"
+
+class VideoPrefetcher {
+public:
+  //! the frame rate used when the video does not give a valid one
+  static const int DEFAULT_FPS = 25;
+
+  VideoPrefetcher() : _running(false) {}
+
+  ~VideoPrefetcher() { stop(); }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * Start decoding a video in the producer thread.
+   * \param filename
+   *    the video file
+   * \param size
+   *    the size of the output frames
+   * \param ring_size
+   *    the number of frames decoded in advance
+   * \return false if the video could not be opened
+   */
+  bool start(const std::string & filename, const cv::Size & size,
+             const unsigned int ring_size = 8) {
+    stop();
+    if (!_capture.open(filename)) {
+      maggiePrint("The video file '%s' was not opened succesfully!",
+                  filename.c_str());
+      return false;
+    }
+    _filename = filename;
+    _size = size;
+    _fps = _capture.get(CV_CAP_PROP_FPS);
+    if (_fps <= 0 || _fps > 200) // some containers do not give it
+      _fps = DEFAULT_FPS;
+    _nb_decoded = 0;
+    _ring.resize(std::max(ring_size, 2u));
+    _ring_pts.resize(_ring.size());
+    _head = _count = 0;
+    _stop = false;
+    _running = true;
+    _thread = boost::thread(&VideoPrefetcher::produce, this);
+    return true;
+  } // end start();
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! stop and join the producer thread
+  void stop() {
+    if (!_running)
+      return;
+    {
+      boost::mutex::scoped_lock lock(_mutex);
+      _stop = true;
+    }
+    _not_full.notify_all();
+    _thread.join();
+    _capture.release();
+    _running = false;
+  } // end stop();
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * Take the next decoded frame, without waiting.
+   * \param out
+   *    its buffer is given back to the producer
+   * \return false if no frame is ready, \a out is then unchanged
+   */
+  bool pop(cv::Mat3b & out) {
+    {
+      boost::mutex::scoped_lock lock(_mutex);
+      if (_count == 0)
+        return false;
+      std::swap(_ring[_head], out);
+      _head = (_head + 1) % _ring.size();
+      --_count;
+    }
+    _not_full.notify_one();
+    return true;
+  } // end pop();
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * Take all the decoded frames whose timestamp is before \a pts,
+   * without waiting. The frames in between are skipped.
+   * \param out, out_pts
+   *    the last frame taken and its timestamp.
+   *    Unchanged if no frame was taken (the previous one is repeated).
+   * \return true if a frame was taken
+   */
+  bool pop_until(const double pts, cv::Mat3b & out, double & out_pts) {
+    bool popped = false;
+    {
+      boost::mutex::scoped_lock lock(_mutex);
+      while (_count > 0 && _ring_pts[_head] <= pts) {
+        std::swap(_ring[_head], out);
+        out_pts = _ring_pts[_head];
+        _head = (_head + 1) % _ring.size();
+        --_count;
+        popped = true;
+      }
+    }
+    if (popped)
+      _not_full.notify_one();
+    return popped;
+  } // end pop_until();
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /*!
+   * Get the next decoded frame without taking it.
+   * \param next
+   *    shares the data of the frame, valid until the next pop
+   * \return false if no frame is ready
+   */
+  bool peek(cv::Mat3b & next, double & next_pts) {
+    boost::mutex::scoped_lock lock(_mutex);
+    if (_count == 0)
+      return false;
+    next = _ring[_head];
+    next_pts = _ring_pts[_head];
+    return true;
+  } // end peek();
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  inline bool is_running() const { return _running; }
+  //! the frame rate of the video, DEFAULT_FPS if the container does not give it
+  inline double fps() const { return _fps; }
+  //! the number of frames decoded in advance
+  inline unsigned int ring_size() const { return _ring.size(); }
+  inline const cv::Size & size() const { return _size; }
+  inline const std::string & filename() const { return _filename; }
+
+private:
+  //////////////////////////////////////////////////////////////////////////////
+
+  //! the producer thread
+  void produce() {
+    while (true) {
+      // decode, rewinding at the end of the video
+      if (!_capture.read(_decoded)) {
+        maggieDebug2("VideoPrefetcher: rewinding '%s'", _filename.c_str());
+        _capture.set(CV_CAP_PROP_POS_FRAMES, 0);
+        if (!_capture.read(_decoded)) {
+          maggiePrint("VideoPrefetcher: impossible to rewind '%s'!",
+                      _filename.c_str());
+          return;
+        }
+      }
+      // wait for a free slot
+      unsigned int slot;
+      {
+        boost::mutex::scoped_lock lock(_mutex);
+        while (!_stop && _count == _ring.size())
+          _not_full.wait(lock);
+        if (_stop)
+          return;
+        slot = (_head + _count) % _ring.size();
+      }
+      // the slot is not read by the consumer until _count is increased
+      cv::resize(_decoded, _ring[slot], _size);
+      _ring_pts[slot] = _nb_decoded++ / _fps;
+      {
+        boost::mutex::scoped_lock lock(_mutex);
+        ++_count;
+      }
+    } // end while (true)
+  } // end produce();
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  std::string _filename;
+  cv::Size _size;
+  cv::VideoCapture _capture;
+  cv::Mat _decoded;
+  //! the decoded frames, from _head to _head + _count - 1
+  std::vector<cv::Mat3b> _ring;
+  //! the timestamps of the frames of the ring, in seconds
+  std::vector<double> _ring_pts;
+  double _fps;
+  //! the number of frames decoded since start(), loops included
+  int _nb_decoded;
+  unsigned int _head, _count;
+  boost::thread _thread;
+  boost::mutex _mutex;
+  boost::condition_variable _not_full;
+  bool _stop, _running;
+}; // end class VideoPrefetcher
+
+#endif // VIDEO_PREFETCHER_H